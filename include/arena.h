@@ -0,0 +1,96 @@
+/** @file arena.h
+ * Bump-pointer allocation for memory which is all released at once.
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    unsigned char data[];
+} ArenaBlock;
+
+/* An arena hands out memory from the front of its current block and
+ * allocates a block twice the size when it runs out. Nothing is freed on its
+ * own; reset_arena() releases every allocation at once and keeps a single
+ * block big enough for everything the arena held, so an arena which is reset
+ * after each use stops calling malloc() once it has seen its largest use.
+ *
+ * The functions which allocate accept a NULL arena and fall back to malloc(),
+ * realloc() and free(), so a structure can be built either way. */
+typedef struct Arena {
+    ArenaBlock *blocks; /* the current block first */
+    size_t block_size;  /* size of the first block */
+    void *last;         /* the latest allocation, which can grow in place */
+} Arena;
+
+/**
+ * Initializes an empty arena. No memory is allocated until it is first used.
+ *
+ * @param arena The arena to initialize.
+ * @param block_size The size of the arena's first block.
+ */
+void init_arena(Arena *arena, size_t block_size);
+
+/**
+ * Allocates size bytes aligned to ARENA_ALIGNMENT from arena, or with
+ * malloc() if arena is NULL.
+ *
+ * @param arena The arena to allocate from, or NULL.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * Resizes an allocation made with arena_alloc(). The latest allocation grows
+ * in place when its block has room, anything else is copied to a new
+ * allocation. With a NULL arena this is realloc().
+ *
+ * @param arena The arena ptr was allocated from, or NULL.
+ * @param ptr The allocation to resize.
+ * @param old_size The allocation's current size.
+ * @param new_size The size to resize it to.
+ * @return A pointer to the resized allocation.
+ */
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Frees ptr if arena is NULL. Memory from an arena is only released by
+ * reset_arena() or free_arena(), so this does nothing otherwise.
+ *
+ * @param arena The arena ptr was allocated from, or NULL.
+ * @param ptr The allocation to free.
+ */
+void arena_free(Arena *arena, void *ptr);
+
+/**
+ * Releases every allocation made from the arena, keeping one block as big as
+ * all of its blocks put together for reuse.
+ *
+ * @param arena The arena to reset.
+ */
+void reset_arena(Arena *arena);
+
+/**
+ * Returns the number of bytes the arena's blocks hold, used or not.
+ *
+ * @param arena The arena to measure.
+ * @return The size of the arena's blocks in bytes.
+ */
+size_t arena_memory_usage(Arena *arena);
+
+/**
+ * Frees all of the arena's memory. The arena can be used again afterwards.
+ *
+ * @param arena The arena to free.
+ */
+void free_arena(Arena *arena);
+
+#endif /* _ARENA_H_ */
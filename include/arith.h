@@ -0,0 +1,140 @@
+/** @file arith.h
+ * Generic forms of the arithmetic and comparison operators shared by the
+ * interpreters. Each computes a op b into result and returns 0 if the operand
+ * types aren't supported by the operator.
+ *
+ * Integers and doubles form a numeric tower: integer operands give an integer
+ * result unless it overflows or, for division, isn't exact, in which case the
+ * result is promoted to a double. Mixing an integer with a double gives a
+ * double.
+ */
+#ifndef _ARITH_H_
+#define _ARITH_H_
+
+#include <string.h>
+
+#include "value.h"
+
+#define IS_NUMBER(v) (IS_INTEGER(v) || IS_DOUBLE(v))
+
+/* the value of an integer or double operand as a double */
+static inline double number_as_double(Value v) {
+    return IS_INTEGER(v) ? (double)AS_INTEGER(v) : AS_DOUBLE(v);
+}
+
+/* integer fast paths, shared with the quickened opcodes */
+static inline Value int_add(long a, long b) {
+    long result;
+    if (__builtin_add_overflow(a, b, &result)) {
+        return double_value((double)a + (double)b);
+    }
+    return int_value(result);
+}
+
+static inline Value int_sub(long a, long b) {
+    long result;
+    if (__builtin_sub_overflow(a, b, &result)) {
+        return double_value((double)a - (double)b);
+    }
+    return int_value(result);
+}
+
+static inline Value int_mult(long a, long b) {
+    long result;
+    if (__builtin_mul_overflow(a, b, &result)) {
+        return double_value((double)a * (double)b);
+    }
+    return int_value(result);
+}
+
+static inline Value int_div(long a, long b) {
+    /* a / -1 is negation, which int_sub promotes when it overflows. LONG_MIN
+     * / -1 and LONG_MIN % -1 both trap */
+    if (b == -1) {
+        return int_sub(0, a);
+    }
+    if (b != 0 && a % b == 0) {
+        return int_value(a / b);
+    }
+    return double_value((double)a / (double)b);
+}
+
+static inline int arith_add(Value a, Value b, Value *result) {
+    if (IS_DOUBLE(a) && IS_DOUBLE(b)) {
+        *result = double_value(AS_DOUBLE(a) + AS_DOUBLE(b));
+    } else if (IS_INTEGER(a) && IS_INTEGER(b)) {
+        *result = int_add(AS_INTEGER(a), AS_INTEGER(b));
+    } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        *result = double_value(number_as_double(a) + number_as_double(b));
+    } else if (IS_STRING(a) && IS_STRING(b)) {
+        *result = add_strings(&b, &a);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static inline int arith_sub(Value a, Value b, Value *result) {
+    if (IS_DOUBLE(a) && IS_DOUBLE(b)) {
+        *result = double_value(AS_DOUBLE(a) - AS_DOUBLE(b));
+    } else if (IS_INTEGER(a) && IS_INTEGER(b)) {
+        *result = int_sub(AS_INTEGER(a), AS_INTEGER(b));
+    } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        *result = double_value(number_as_double(a) - number_as_double(b));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static inline int arith_mult(Value a, Value b, Value *result) {
+    if (IS_DOUBLE(a) && IS_DOUBLE(b)) {
+        *result = double_value(AS_DOUBLE(a) * AS_DOUBLE(b));
+    } else if (IS_INTEGER(a) && IS_INTEGER(b)) {
+        *result = int_mult(AS_INTEGER(a), AS_INTEGER(b));
+    } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        *result = double_value(number_as_double(a) * number_as_double(b));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static inline int arith_cmp(Value a, Value b, Value *result) {
+    if (IS_INTEGER(a) && IS_INTEGER(b)) {
+        *result = bool_value(AS_INTEGER(a) == AS_INTEGER(b));
+    } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        *result = bool_value(number_as_double(a) == number_as_double(b));
+    } else if (IS_STRING(a) && IS_STRING(b)) {
+        *result = bool_value(strcmp(AS_STRING(a), AS_STRING(b)) == 0);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static inline int arith_div(Value a, Value b, Value *result) {
+    if (IS_DOUBLE(a) && IS_DOUBLE(b)) {
+        *result = double_value(AS_DOUBLE(a) / AS_DOUBLE(b));
+    } else if (IS_INTEGER(a) && IS_INTEGER(b)) {
+        *result = int_div(AS_INTEGER(a), AS_INTEGER(b));
+    } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        *result = double_value(number_as_double(a) / number_as_double(b));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static inline int arith_negate(Value a, Value *result) {
+    if (IS_DOUBLE(a)) {
+        *result = double_value(-AS_DOUBLE(a));
+    } else if (IS_INTEGER(a)) {
+        *result = int_sub(0, AS_INTEGER(a));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+#endif /* _ARITH_H_ */
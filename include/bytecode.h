@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 
+#include "arena.h"
 #include "common.h"
 #include "tokens.h"
 #include "value.h"
@@ -21,38 +22,87 @@ typedef enum {
     OP_MULT,
     OP_DIV,
     OP_CMP,
+    OP_NEGATE,
+
+    /* type-specialized forms which evaluate() rewrites OP_ADD and friends
+     * into once it has seen the operand types at that site */
+    OP_ADD_DD,
+    OP_ADD_II,
+    OP_ADD_SS,
+    OP_SUB_DD,
+    OP_SUB_II,
+    OP_MULT_DD,
+    OP_MULT_II,
+    OP_DIV_DD,
+    OP_DIV_II,
+
+    /* superinstructions emitted by fuse_superinstructions() */
+    OP_ADD_CONST,
+    OP_SUB_CONST,
+    OP_MULT_CONST,
+    OP_DIV_CONST,
+    OP_CMP_CONST,
+    OP_GET_GLOBAL2,
+
+    /* type-specialized forms of the superinstructions, quickened like the
+     * forms of OP_ADD above */
+    OP_ADD_CONST_DD,
+    OP_ADD_CONST_II,
+    OP_SUB_CONST_DD,
+    OP_SUB_CONST_II,
+    OP_MULT_CONST_DD,
+    OP_MULT_CONST_II,
+    OP_DIV_CONST_DD,
+    OP_DIV_CONST_II,
 } opcode;
 
+/* Like TokenArray, a ValueArray or BytecodeArray created with an arena grows
+ * within it and is released with it rather than by its free function. */
 typedef struct {
     Value *array;
+    Arena *arena;
     uint32_t elements;
     uint32_t capacity;
 } ValueArray;
 
+/* keys holds each name's hash and length, as cached by the symbol table, so
+ * looking a name up in another table doesn't hash it again. */
+typedef struct {
+    uint32_t hash;
+    uint32_t length;
+} NameKey;
+
 typedef struct {
     char **array;
+    NameKey *keys;
     uint32_t elements;
     uint32_t capacity;
 } NameArray;
 
+/* max_stack is the deepest the value stack gets while the chunk runs, as
+ * computed by the parser, so evaluate() can reserve it once on entry. */
 typedef struct {
     uint8_t *array;
     NameArray *names;
     ValueArray *constants;
+    Arena *arena;
     uint32_t elements;
     uint32_t capacity;
+    uint32_t max_stack;
 } BytecodeArray;
 
 
 /* array ops */
 
 /**
- * Allocates a BytecodeArray on the heap and initializes its values to defaults.
- * Must be freed with free_bytecode_dynarray().
+ * Allocates a BytecodeArray and initializes its values to defaults. Must be
+ * freed with free_bytecode_dynarray().
  *
+ * @param arena The arena to allocate the array and its constants from, or NULL
+ *              to allocate them on the heap.
  * @return A pointer to a default initialized BytecodeArray.
  */
-BytecodeArray *create_bytecode_dynarray();
+BytecodeArray *create_bytecode_dynarray(Arena *arena);
 
 /**
  * Resizes the array if necessary and then adds an opcode to the array.
@@ -73,7 +123,7 @@ void append_to_bytecode_dynarray(BytecodeArray *array, opcode_t op);
 opcode_t *next_opcode(BytecodeArray *array, ArrayIterator *iter);
 
 /**
- * Frees a heap-allocated bytecode array and sets the pointer to NULL.
+ * Frees a bytecode array and its constants, unless they belong to an arena.
  *
  * @param array Pointer to the array to be freed.
  */
@@ -81,55 +131,63 @@ void free_bytecode_dynarray(BytecodeArray *array);
 
 
 /**
- * Allocates a ValueArray on the heap and initializes its values to defaults.
- * Must be freed with free_value_dynarray().
+ * Allocates a ValueArray and initializes its values to defaults. Must be freed
+ * with free_value_dynarray().
  *
+ * @param arena The arena to allocate the array from, or NULL to allocate it on
+ *              the heap.
  * @return A pointer to a default initialized ValueArray.
  */
-ValueArray *create_value_dynarray();
+ValueArray *create_value_dynarray(Arena *arena);
 
 /**
- * Resizes the array if necessary and then adds an value to the array.
+ * Resizes the array if necessary and then adds an value to the array. The
+ * array holds at most MAX_CHUNK_CONSTANTS values.
  *
  * @param array The Array to append to.
  * @param val The value to append to the array.
+ * @return 1 if the value was added, 0 if the array is full.
  */
-void append_to_value_dynarray(ValueArray *array, Value val);
+unsigned int append_to_value_dynarray(ValueArray *array, Value val);
 
 /**
- * Frees a heap-allocated value array and sets the pointer to NULL.
+ * Frees a value array, unless it belongs to an arena.
  *
  * @param array Pointer to the array to be freed.
  */
 void free_value_dynarray(ValueArray *array);
 
 /**
- * Returns a NameArray struct. Names added to the struct must be freed with
- * free_name_dynarray().
+ * Returns a NameArray struct. Must be freed with free_name_dynarray().
  *
  * @return A default initialized NameArray.
  */
 NameArray create_name_dynarray();
 
 /**
- * Resizes the array if necessary and then adds a string to the array.
+ * Resizes the array if necessary and then adds a string to the array. The
+ * array stores the pointer itself, names are owned by the VM's symbol table.
+ * The array holds at most MAX_CHUNK_NAMES names.
  *
  * @param array The Array to append to.
  * @param val The string to append to the array.
+ * @param hash The string's hash_bytes() hash.
+ * @param length The string's length.
+ * @return 1 if the name was added, 0 if the array is full.
  */
-void append_to_name_dynarray(NameArray *array, char *val);
+unsigned int append_to_name_dynarray(NameArray *array, char *val, uint32_t hash, uint32_t length);
 
 /**
- * Frees strings added to a name array.
+ * Frees a name array, but not the names in it.
  *
  * @param array Pointer to the array to free.
  */
 void free_name_dynarray(NameArray *array);
 
-#ifdef DEBUG_VM
+#ifdef DEBUG_COMPILER
 void print_disassembly(BytecodeArray *bytecode);
 void print_constants(BytecodeArray *bytecode);
 void print_names(BytecodeArray *bytecode);
-#endif /* DEBUG_VM */
+#endif /* DEBUG_COMPILER */
 
 #endif /* _BYTECODE_H_ */
@@ -9,8 +9,31 @@
 #undef DEBUG_COMPILER
 #undef DEBUG_TABLE
 
+/* evaluate() dispatches with gcc's labels-as-values when available. build
+ * with -DNO_THREADED_DISPATCH to fall back to a plain switch */
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+/* Values are NaN-boxed into 64 bits on targets whose pointers fit in 48 bits.
+ * build with -DNO_NAN_BOXING to use the tagged union instead */
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(NO_NAN_BOXING)
+#define NAN_BOXING
+#endif
+
+/* tokenize() skips whitespace and finds where identifiers, numbers and strings
+ * end a vector of characters at a time, 16 with SSE2 or 32 when built for
+ * AVX2. build with -DNO_SIMD_SCAN to scan a character at a time */
+#if (defined(__SSE2__) || defined(__AVX2__)) && !defined(NO_SIMD_SCAN)
+#define SIMD_SCAN
+#endif
+
 #define INPUT_BUFFER_SIZE 1024
-#define STACK_SIZE 1024
+
+/* The VM stack starts out small so idle VMs are cheap, and is grown by
+ * relocation up to STACK_MAX_SIZE values when a chunk needs more. */
+#define STACK_INITIAL_SIZE 16
+#define STACK_MAX_SIZE (1 << 20)
 
 #define MAX_CHUNK_CONSTANTS 256
 #define MAX_CHUNK_NAMES 256
@@ -0,0 +1,34 @@
+/** @file hash.h
+ * String hashing for hash table keys.
+ *
+ * The hash is in the wyhash family: keys are consumed 8 bytes at a time and
+ * mixed with 64x64->128 bit multiplies. Every process picks a random seed at
+ * startup, so scripts can't precompute keys which all collide.
+ */
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hashes length bytes starting at bytes with the given seed.
+ *
+ * @param bytes The bytes to hash.
+ * @param length The number of bytes to hash.
+ * @param seed The seed mixed into the hash.
+ * @return A 64-bit hash.
+ */
+uint64_t hash_bytes_seeded(const void *bytes, size_t length, uint64_t seed);
+
+/**
+ * Hashes length bytes starting at bytes with the per-process seed, folded to
+ * 32 bits for use by hash tables.
+ *
+ * @param bytes The bytes to hash.
+ * @param length The number of bytes to hash.
+ * @return A 32-bit hash.
+ */
+uint32_t hash_bytes(const void *bytes, size_t length);
+
+#endif /* _HASH_H_ */
@@ -0,0 +1,29 @@
+/** @file optimize.h
+ * Passes which rewrite a compiled BytecodeArray before it is executed.
+ */
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include "bytecode.h"
+
+/**
+ * Returns the length in bytes of an instruction, including its operands.
+ *
+ * @param op The instruction's opcode.
+ * @return The length of the instruction.
+ */
+unsigned int instruction_length(opcode_t op);
+
+/**
+ * Replaces common opcode sequences with a single superinstruction, rewriting
+ * the array in place:
+ *
+ * - OP_CONSTANT k; OP_ADD (or OP_SUB, OP_MULT, OP_DIV, OP_CMP) becomes
+ *   OP_ADD_CONST k (OP_SUB_CONST k, ...)
+ * - OP_GET_GLOBAL n; OP_GET_GLOBAL m becomes OP_GET_GLOBAL2 n m
+ *
+ * @param bytecode The bytecode to rewrite.
+ */
+void fuse_superinstructions(BytecodeArray *bytecode);
+
+#endif /* _OPTIMIZE_H_ */
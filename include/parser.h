@@ -7,14 +7,42 @@
 #include "bytecode.h"
 #include "common.h"
 #include "error.h"
+#include "register_vm.h"
+#include "tokenize.h"
 #include "tokens.h"
 #include "vm.h"
 
+/* the number of tokens the parser keeps, a power of two */
+#define PARSER_RING_SIZE 4
+
+/* The parser emits either stack bytecode (bytecode is set) or register code
+ * (regcode is set). When emitting register code, operands is a compile-time
+ * stack of RK operands standing in for the values the stack VM would push,
+ * and registers are allocated and freed in stack order. When emitting stack
+ * bytecode, depth is the number of values the emitted code leaves on the
+ * stack.
+ *
+ * Tokens are pulled one at a time from lexer, or from tokens when parsing a
+ * token array, into ring, where current and prev point. A slot is reused
+ * PARSER_RING_SIZE tokens later, so parsing functions copy any token they
+ * need after parsing a subexpression. */
 typedef struct ParserState {
+    const char *source;
     Token *current;
     Token *prev;
-    ArrayIterator *iter;
+    Lexer *lexer;
+    TokenArray *tokens;
+    unsigned int read;
+    Token ring[PARSER_RING_SIZE];
     BytecodeArray *bytecode;
+    RegisterCode *regcode;
+    HashTable *symbols;
+    NameArray *names;
+    ValueArray *constants;
+    uint16_t operands[MAX_REGISTERS];
+    unsigned int operand_count;
+    unsigned int next_register;
+    int depth;
     unsigned int error;
 } ParserState;
 
@@ -46,11 +74,52 @@ typedef struct Rule {
  * which uses operator precedence referenced in a table to correctly parse operator precedence
  * and overall simplify the parsing code versus a recursive descent parser.
  *
+ * The bytecode is allocated from the same arena as tokens, if they have one.
+ *
  * @param vm A pointer to a virtual machine which includes global variables
  *           which can be referenced by the parser
  * @param tokens A token array to parse and compile into bytecode
- * @return An array of bytecode which can be run with execute()
+ * @return An array of bytecode which can be run with execute(),
+ *         or NULL if the tokens couldn't be compiled
  */
 BytecodeArray *parse(VirtualMachine *vm, TokenArray *tokens);
 
+/**
+ * Like parse(), but compiles the tokens to three-address register code for
+ * evaluate_register() instead of stack bytecode. Constants and global reads
+ * are used directly as instruction operands where possible.
+ *
+ * @param vm A pointer to a virtual machine which includes global variables
+ *           which can be referenced by the parser
+ * @param tokens A token array to parse and compile into register code
+ * @return An array of register code which can be run with execute_register(),
+ *         or NULL if the tokens couldn't be compiled
+ */
+RegisterCode *parse_register(VirtualMachine *vm, TokenArray *tokens);
+
+/**
+ * Like parse(), but lexes source as it goes instead of taking a token array.
+ * Compiling takes one pass over source and a fixed amount of memory for tokens
+ * whatever its length.
+ *
+ * @param vm A pointer to a virtual machine which includes global variables
+ *           which can be referenced by the parser
+ * @param source A source code string to compile into bytecode
+ * @param arena The arena to allocate the bytecode from, or NULL for the heap.
+ * @return An array of bytecode which can be run with execute(),
+ *         or NULL if the source couldn't be compiled
+ */
+BytecodeArray *parse_source(VirtualMachine *vm, const char *source, Arena *arena);
+
+/**
+ * Like parse_register(), but lexes source as it goes, see parse_source().
+ *
+ * @param vm A pointer to a virtual machine which includes global variables
+ *           which can be referenced by the parser
+ * @param source A source code string to compile into register code
+ * @return An array of register code which can be run with execute_register(),
+ *         or NULL if the source couldn't be compiled
+ */
+RegisterCode *parse_register_source(VirtualMachine *vm, const char *source);
+
 #endif /* GRAMMAR_H_ */
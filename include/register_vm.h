@@ -0,0 +1,107 @@
+/** @file register_vm.h
+ * Three-address register bytecode and the virtual machine which runs it, an
+ * alternative to the stack-based OP_ bytecode run by evaluate().
+ *
+ * Instructions are 32 bits wide, laid out like Lua's:
+ *
+ *     | C (9 bits) | B (9 bits) | A (8 bits) | op (6 bits) |
+ *
+ * A always names a register. B and C are "RK" operands: a register if
+ * RK_CONSTANT is clear, otherwise the index of a constant. Instructions which
+ * need one wide operand use Bx, the 18 bits of B and C together.
+ */
+#ifndef _REGISTER_VM_H_
+#define _REGISTER_VM_H_
+
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "common.h"
+#include "value.h"
+#include "vm.h"
+
+typedef uint32_t instruction_t;
+
+typedef enum {
+    ROP_RETURN,     /* A = 1 if there is a result, B = result (RK) */
+    ROP_GET_GLOBAL, /* R(A) = globals[Bx] */
+    ROP_SET_GLOBAL, /* globals[A] = RK(B) */
+    ROP_ADD,        /* R(A) = RK(B) + RK(C) */
+    ROP_SUB,        /* R(A) = RK(B) - RK(C) */
+    ROP_MULT,       /* R(A) = RK(B) * RK(C) */
+    ROP_DIV,        /* R(A) = RK(B) / RK(C) */
+    ROP_CMP,        /* R(A) = RK(B) == RK(C) */
+    ROP_NEGATE,     /* R(A) = -RK(B) */
+} reg_opcode;
+
+#define MAX_REGISTERS 256
+#define RK_CONSTANT 0x100
+
+#define REG_OP(i) ((i) & 0x3f)
+#define REG_A(i)  (((i) >> 6) & 0xff)
+#define REG_B(i)  (((i) >> 14) & 0x1ff)
+#define REG_C(i)  (((i) >> 23) & 0x1ff)
+#define REG_BX(i) ((i) >> 14)
+
+#define ENCODE_ABC(op, a, b, c) \
+    ((instruction_t)(op) | ((instruction_t)(a) << 6) | ((instruction_t)(b) << 14) | ((instruction_t)(c) << 23))
+#define ENCODE_ABX(op, a, bx) \
+    ((instruction_t)(op) | ((instruction_t)(a) << 6) | ((instruction_t)(bx) << 14))
+
+typedef struct {
+    instruction_t *array;
+    NameArray *names;
+    ValueArray *constants;
+    unsigned int registers; /* number of registers the code needs */
+    uint32_t elements;
+    uint32_t capacity;
+} RegisterCode;
+
+/**
+ * Allocates a RegisterCode array on the heap and initializes its values to
+ * defaults. Must be freed with free_register_code().
+ *
+ * @return A pointer to a default initialized RegisterCode.
+ */
+RegisterCode *create_register_code();
+
+/**
+ * Resizes the array if necessary and then adds an instruction to the array.
+ *
+ * @param code The array to append to.
+ * @param instruction The instruction to append to the array.
+ */
+void append_to_register_code(RegisterCode *code, instruction_t instruction);
+
+/**
+ * Frees a heap-allocated register code array.
+ *
+ * @param code Pointer to the array to be freed.
+ */
+void free_register_code(RegisterCode *code);
+
+/**
+ * Takes a virtual machine and register code and executes the code, using the
+ * virtual machine's stack above its head as the register file and leaving the
+ * result, if any, on top of the stack.
+ *
+ * @param vm
+ * @param code
+ */
+void evaluate_register(VirtualMachine *vm, RegisterCode *code);
+
+/**
+ * Takes a virtual machine and register code and executes the code. If there is
+ * a value left on the virtual machine's stack it pops and prints the value.
+ *
+ * @param vm
+ * @param code
+ * @return success
+ */
+unsigned int execute_register(VirtualMachine *vm, RegisterCode *code);
+
+#ifdef DEBUG_COMPILER
+void print_register_disassembly(RegisterCode *code);
+#endif /* DEBUG_COMPILER */
+
+#endif /* _REGISTER_VM_H_ */
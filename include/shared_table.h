@@ -0,0 +1,111 @@
+/** @file shared_table.h
+ * A hash table of globals which many threads, and the VMs running on them,
+ * can read and write at once.
+ */
+#ifndef _SHARED_TABLE_H_
+#define _SHARED_TABLE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "value.h"
+
+#define SHARED_TABLE_DEFAULT_SIZE 16
+#define SHARED_TABLE_STRIPES 16
+
+/* words a value is stored in, so it can be copied without tearing words */
+#define SHARED_VALUE_WORDS ((sizeof(Value) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+/* The table is built for read-mostly data such as configuration shared by
+ * worker threads, and readers never take a lock.
+ *
+ * Keys are only ever added, never removed, and a slot's key is published
+ * after its value, so a reader which finds a key finds a complete entry.
+ * Values can be replaced, which is guarded per stripe (a slice of the hash
+ * space) by a mutex for writers and a sequence count for readers: a writer
+ * makes the count odd while it stores, and a reader retries when the count
+ * was odd or changed under it. Writers to different stripes don't contend.
+ *
+ * Adding a key takes insert_lock. Growing the table also takes every stripe
+ * lock, copies the slots into a new snapshot and publishes it atomically.
+ * Readers still probing the old snapshot see consistent, if stale, slots, so
+ * old snapshots are retired rather than freed until the table is. The
+ * retired snapshots add up to less than the current one. */
+typedef struct SharedSlot {
+    const char *key;
+    uint32_t hash;
+    uint32_t length;
+    uint64_t value[SHARED_VALUE_WORDS];
+} SharedSlot;
+
+typedef struct SharedSnapshot {
+    unsigned int capacity;
+    struct SharedSnapshot *retired;
+    SharedSlot slots[];
+} SharedSnapshot;
+
+typedef struct SharedStripe {
+    pthread_mutex_t lock;
+    unsigned int sequence;
+} __attribute__((aligned(64))) SharedStripe;
+
+typedef struct SharedTable {
+    SharedSnapshot *current;
+    unsigned int elements;
+    pthread_mutex_t insert_lock;
+    SharedStripe stripes[SHARED_TABLE_STRIPES];
+} SharedTable;
+
+/**
+ * Heap-allocates and initializes an empty shared table. Must be freed with
+ * free_shared_table() once no thread uses it.
+ *
+ * @return An initialized shared table.
+ */
+SharedTable *init_shared_table();
+
+/**
+ * Frees a shared table, its keys and its retired snapshots. Values aren't
+ * freed, they belong to whoever stored them.
+ *
+ * @param table The table to free.
+ */
+void free_shared_table(SharedTable *table);
+
+/**
+ * Sets the value associated with key, adding a copy of key if it isn't in the
+ * table yet. Safe to call from any thread.
+ *
+ * @param table The table to store into.
+ * @param key The name of the value.
+ * @param value The value to store.
+ */
+void shared_table_set(SharedTable *table, const char *key, Value value);
+
+/**
+ * Looks up key without locking. Safe to call from any thread, concurrently
+ * with shared_table_set(). The value copied out is one that was stored whole.
+ *
+ * @param table The table to search.
+ * @param key The name of the value.
+ * @param value Set to the key's value if it is found.
+ * @return 1 if key was found, 0 otherwise.
+ */
+int shared_table_get(SharedTable *table, const char *key, Value *value);
+
+/**
+ * Like shared_table_get(), for a key whose hash_bytes() hash and length are
+ * already known.
+ *
+ * @param table The table to search.
+ * @param key The name of the value.
+ * @param hash The key's hash.
+ * @param length The key's length.
+ * @param value Set to the key's value if it is found.
+ * @return 1 if key was found, 0 otherwise.
+ */
+int shared_table_get_hashed(SharedTable *table, const char *key, uint32_t hash, uint32_t length,
+        Value *value);
+
+#endif /* _SHARED_TABLE_H_ */
@@ -16,19 +16,59 @@
 #define TABLE_DEFAULT_SIZE 8
 #define HEAP_ALLOCD
 
+/* The table uses Robin Hood linear probing: an insert takes the slot of any
+ * entry which is closer to its home slot than the new entry is to its own, so
+ * probe lengths stay short and even, and deletion shifts the following entries
+ * back instead of leaving tombstones.
+ *
+ * Besides the entries there is an array of control bytes, one per slot, which
+ * lookups scan TABLE_GROUP_WIDTH slots at a time (with SSE2 where available).
+ * A full slot's control byte holds 7 bits of its key's hash, so a probe only
+ * touches entries whose hash fragment matches. The first TABLE_GROUP_WIDTH - 1
+ * control bytes are repeated after the last slot so a scan never wraps.
+ *
+ * Slots don't hold entries themselves but their number in a dense entries
+ * array, as 8, 16 or 32 bit integers depending on the capacity. Entries are
+ * appended in insertion order, so iterating a table walks one contiguous array
+ * in a deterministic order, and Robin Hood displacement only moves the small
+ * indices. A deleted entry leaves a hole (a NULL key) which is dropped the
+ * next time the table is rebuilt. */
+#define TABLE_GROUP_WIDTH 16
+
+#define CTRL_EMPTY    ((int8_t)-128)
+#define CTRL_IS_FULL(c) ((c) >= 0)
+
+/* hash and length are cached when the entry is added, so probes can reject
+ * keys without touching their bytes and resizes never rehash them */
 typedef struct Entry {
     char *key;
+    uint32_t hash;
+    uint32_t length;
     Value value;
-    unsigned char occupied;
-    unsigned char deleted;
 } Entry;
 
 typedef struct HashTable {
-    Entry *entries;    
+    int8_t *ctrl;
+    void *indices;
+    Entry *entries;
     unsigned int elements;
+    unsigned int used;     /* entries appended, including holes */
     unsigned int capacity;
+    unsigned int max_probe; /* longest distance of an entry from its home slot */
 } HashTable;
 
+/* A snapshot of a table's shape, for monitoring. holes are deleted entries
+ * still taking up room in the entries array until the table is rebuilt, and
+ * max_probe is the longest probe since the last rebuild. memory is as counted
+ * by table_memory_usage(). */
+typedef struct TableStats {
+    unsigned int capacity;
+    unsigned int elements;
+    unsigned int holes;
+    unsigned int max_probe;
+    size_t memory;
+} TableStats;
+
 /**
  * Heap-allocates memory for a hash table and initializes it. Must be freed with
  * free_table().
@@ -45,9 +85,9 @@ HashTable *init_table();
 void free_table(HashTable *table);
 
 /**
- * Adds a key and value to the hash table. When retrieving the value later, the
- * table compares the pointer rather than the string, so the pointer to key must
- * never be lost to be able to later retrieve the value.
+ * Adds a key and value to the hash table. The table keeps the pointer to key
+ * rather than a copy, so the string must outlive its entry. Keys are looked up
+ * by their contents, so any equal string finds the entry.
  *
  * @param table The table to add the key-value pair to.
  * @param key A string identifying the value.
@@ -55,6 +95,13 @@ void free_table(HashTable *table);
  */
 void add_entry(HashTable *table, char *key, Value value);
 
+/**
+ * Replaces the value associated with key, if key is in the table.
+ *
+ * @param table The table containing key.
+ * @param key The key the value is associated with.
+ * @param value The new value.
+ */
 void update_entry(HashTable *table, char *key, Value value);
 
 /**
@@ -67,6 +114,21 @@ void update_entry(HashTable *table, char *key, Value value);
  */
 Entry *get_entry(HashTable *table, char *key);
 
+/**
+ * Sets the value associated with key, adding key to the table if it isn't
+ * already there. Finding and inserting share one probe, so redefining a key
+ * costs a single lookup and never adds a duplicate entry. A newly added key is
+ * kept by pointer, as with add_entry().
+ *
+ * The returned entry is only valid until the table is next modified.
+ *
+ * @param table The table to add or update key in.
+ * @param key A string identifying the value.
+ * @param value The value to be associated with the key.
+ * @return The entry for key.
+ */
+Entry *upsert_entry(HashTable *table, char *key, Value value);
+
 /**
  * Deletes a key-value pair from the table.
  *
@@ -74,6 +136,83 @@ Entry *get_entry(HashTable *table, char *key);
  * @param key The key to a value to be deleted.
  */
 void del_entry(HashTable *table, char *key);
+
+/**
+ * Interns a string: looks for a key equal to the length bytes at chars and
+ * adds a heap-allocated, NUL terminated copy of them with a nil value if there
+ * is none. Keys added this way are unique within the table, so they can be
+ * compared by pointer, and must be freed with free_table_keys().
+ *
+ * The returned entry is only valid until the table is next modified, but its
+ * key stays valid for the table's lifetime.
+ *
+ * @param table The table of interned strings.
+ * @param chars The string to intern, which needn't be NUL terminated.
+ * @param length The length of the string.
+ * @return The entry for the interned string.
+ */
+Entry *intern_entry(HashTable *table, const char *chars, unsigned int length);
+
+/**
+ * Iterates over the table's entries in the order they were added. position
+ * must start at 0 and is advanced past the returned entry. Adding or deleting
+ * entries while iterating invalidates position.
+ *
+ * @param table The table to iterate over.
+ * @param position The iterator's position, which is updated.
+ * @return The next entry, or NULL once every entry has been returned.
+ */
+Entry *table_next_entry(HashTable *table, unsigned int *position);
+
+/**
+ * Frees every key in the table, for tables which own their keys such as those
+ * filled by intern_entry(). Must be called before free_table().
+ *
+ * @param table The table whose keys to free.
+ */
+void free_table_keys(HashTable *table);
+
+/**
+ * Returns the number of bytes the table has allocated for itself: the table,
+ * its control bytes, its slot indices and its entries array. Keys and heap
+ * values belong to the caller and aren't counted.
+ *
+ * @param table The table to measure.
+ * @return The table's footprint in bytes.
+ */
+size_t table_memory_usage(HashTable *table);
+
+/**
+ * Fills in stats with the table's capacity, live entries, holes, longest
+ * probe and memory usage.
+ *
+ * @param table The table to describe.
+ * @param stats The stats to fill in.
+ */
+void table_stats(HashTable *table, TableStats *stats);
+
+/**
+ * Shrinks the table to the smallest capacity which holds its entries and
+ * drops the holes deleted entries left. del_entry() only shrinks a table once
+ * it is under 15% full, so this reclaims memory after bulk deletes which
+ * stopped short of that. Entries keep their order, but Entry pointers into
+ * the table are invalidated.
+ *
+ * @param table The table to compact.
+ */
+void table_compact(HashTable *table);
+
+/**
+ * Counts the table's entries by their probe length, the distance from the
+ * slot their hash maps to. histogram[i] is the number of entries i slots from
+ * home, and the last bucket also counts every longer probe.
+ *
+ * @param table The table to measure.
+ * @param histogram An array of bucket counts to fill in.
+ * @param buckets The length of histogram.
+ */
+void table_probe_histogram(HashTable *table, unsigned int *histogram, unsigned int buckets);
+
 #ifdef DEBUG_TABLE
 void print_table(HashTable *table);
 #endif /* DEBUG_TABLE */
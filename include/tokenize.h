@@ -4,16 +4,54 @@
 
 #include "tokens.h"
 
-#define CHAR_BUF_SZ 1024
+/* A Lexer hands out the tokens of source one at a time, so a consumer which
+ * doesn't keep them, like the parser, compiles any amount of source with a
+ * fixed amount of token memory. tokenize() is a Lexer run to the end. */
+typedef struct {
+    const char *source;
+    unsigned int size;
+    unsigned int pos;
+} Lexer;
+
+/**
+ * Sets up a lexer to read source from the start. Tokens refer to their text in
+ * source, which must outlive them.
+ *
+ * @param lexer The lexer to initialize.
+ * @param source A source code string to be tokenized
+ */
+void init_lexer(Lexer *lexer, const char *source);
+
+/**
+ * Reads the next token from the lexer's source.
+ *
+ * @param lexer The lexer to read from.
+ * @return The next token, or a T_EOF token once the source is used up and on
+ *         every call after that.
+ */
+Token lex_token(Lexer *lexer);
 
 /**
  * Takes a source code string and breaks it into tokens which represent
  * symbols or keywords in the language to be validated and parsed by parse().
+ * Tokens refer to their text in source rather than copying it, so source must
+ * outlive the token array.
+ *
+ * @param source A source code string to be tokenized
+ * @return An array of tokens generated from the source code
+ */
+TokenArray *tokenize(const char *source);
+
+/**
+ * Like tokenize(), but allocates the token array from arena so that it is
+ * released with the arena. parse() allocates the chunk it compiles from such
+ * an array from the same arena.
  *
+ * @param arena The arena to allocate the tokens from.
  * @param source A source code string to be tokenized
  * @return An array of tokens generated from the source code
  */
-TokenArray *tokenize(char *source);
+TokenArray *tokenize_in(Arena *arena, const char *source);
 
 /**
  * Prints out all of the tokens in a token array
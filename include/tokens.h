@@ -2,6 +2,7 @@
 #ifndef _TOKENS_H_
 #define _TOKENS_H_
 
+#include "arena.h"
 #include "common.h"
 
 typedef struct token Token;
@@ -16,6 +17,7 @@ typedef enum {
     T_IDENTIFIER,
     T_STRING,
     T_NUMBER,
+    T_INTEGER,
     T_BOOLEAN,
 
     T_AND,
@@ -69,26 +71,46 @@ typedef enum {
 } TokenType;
 
 
+/* Tokens don't own their text: offset and length locate it in the source the
+ * TokenArray was made from, which must outlive the tokens. A string token is
+ * the text between its quotes. */
 struct token {
-    char *value;
+    unsigned int offset;
+    unsigned int length;
     TokenType type;
     unsigned int line;
 };
 
+/* arena is where tokens was allocated, or NULL for the heap. */
 struct TokenArray {
     Token *tokens;
+    const char *source;
+    Arena *arena;
     unsigned int capacity;
     unsigned int count;
 };
 
 /* token ops */
 
+/**
+ * Returns a pointer to the first character of a token's text. The text isn't
+ * NUL terminated, it is t->length characters long.
+ *
+ * @param array The array the token belongs to.
+ * @param t Pointer to a token in array.
+ * @return The token's text in the source.
+ */
+static inline const char *token_text(TokenArray *array, Token *t) {
+    return array->source + t->offset;
+}
+
 /**
  * Prints out a token in the form (TYPE) or (TYPE, VALUE)
  *
+ * @param source The source the token was made from.
  * @param t Pointer to a token to print.
  */
-void print_token(Token *t);
+void print_token(const char *source, Token *t);
 
 /**
  * Returns an empty Token struct.
@@ -97,21 +119,16 @@ void print_token(Token *t);
  */
 Token create_token();
 
-/**
- * Frees a token if its value is not NULL.
- *
- * @param t Pointer to a token to free.
- */
-void free_token(Token *t);
-
 /* array ops */
 /**
- * Allocates a TokenArray on the heap and initializes its values to defaults.
- * Must be freed with free_array().
+ * Allocates a TokenArray and initializes its values to defaults. Must be freed
+ * with free_array(), which is only needed for a heap-allocated array.
  *
- * @return A pointer to a heap-allocated TokenArray.
+ * @param arena The arena to allocate the array and its tokens from, or NULL to
+ *              allocate them on the heap.
+ * @return A pointer to the new TokenArray.
  */
-TokenArray *create_token_dyn_array();
+TokenArray *create_token_dyn_array(Arena *arena);
 
 /**
  * Resizes the array if necessary and appends a Token.
@@ -122,7 +139,8 @@ TokenArray *create_token_dyn_array();
 void append_to_array(TokenArray *array, Token *t);
 
 /**
- * Frees a heap-allocated TokenArray and sets the pointer to NULL.
+ * Frees a TokenArray. An array allocated from an arena is left for the arena
+ * to release.
  *
  * @param array Pointer to the array to free.
  */
@@ -1,11 +1,18 @@
-/** @file value.h */
+/** @file value.h
+ * Values are manipulated only through the IS_x(), AS_x() and VALUE_TYPE()
+ * macros and the x_value() constructors, so the representation can be either
+ * a NaN-boxed 64-bit word (NAN_BOXING, see common.h) or a tagged union.
+ */
 #ifndef _VALUE_H_
 #define _VALUE_H_
 
+#include <limits.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "common.h"
 
-typedef struct value Value;
 typedef struct object Object;
 
 enum value_type {
@@ -14,7 +21,8 @@ enum value_type {
     VAL_TYPE_INTEGER,
     VAL_TYPE_DOUBLE,
     VAL_TYPE_STRING,
-    VAL_TYPE_BOOLEAN
+    VAL_TYPE_BOOLEAN,
+    VAL_TYPE_UNDEFINED
 };
 
 typedef enum object_type {
@@ -25,6 +33,144 @@ struct object {
     object_type type;
 };
 
+typedef struct {
+    Object obj;
+    unsigned int length;
+    char *chars;
+} string_obj;
+
+#ifdef NAN_BOXING
+
+/* Doubles are stored as their raw bits. Every other value lives inside a
+ * quiet NaN (QNAN): nil, booleans and 48-bit integers are told apart by the
+ * two tag bits 48-49, and pointers additionally set the sign bit, with tag
+ * bit 48 separating objects from strings. The low 48 bits hold the payload. */
+typedef uint64_t Value;
+
+#define SIGN_BIT     ((uint64_t)0x8000000000000000)
+#define QNAN         ((uint64_t)0x7ffc000000000000)
+#define CANONICAL_NAN ((uint64_t)0x7ff8000000000000)
+#define TAG_MASK     ((uint64_t)3 << 48)
+#define PAYLOAD_MASK ((uint64_t)0x0000ffffffffffff)
+#define BOX_MASK     (SIGN_BIT | QNAN | TAG_MASK)
+
+#define TAG_NIL      (QNAN | ((uint64_t)1 << 48))
+#define TAG_BOOLEAN  (QNAN | ((uint64_t)2 << 48))
+#define TAG_INTEGER  (QNAN | ((uint64_t)3 << 48))
+#define TAG_STRING   (SIGN_BIT | QNAN)
+#define TAG_OBJ      (SIGN_BIT | QNAN | ((uint64_t)1 << 48))
+
+/* integers outside this range are stored as doubles by int_value() */
+#define VALUE_INT_MAX ((long)(PAYLOAD_MASK >> 1))
+#define VALUE_INT_MIN (-VALUE_INT_MAX - 1)
+
+#define IS_DOUBLE(v)  (((v) & QNAN) != QNAN)
+#define IS_UNDEFINED(v) ((v) == QNAN)
+#define IS_NIL(v)     ((v) == TAG_NIL)
+#define IS_BOOLEAN(v) (((v) & BOX_MASK) == TAG_BOOLEAN)
+#define IS_INTEGER(v) (((v) & BOX_MASK) == TAG_INTEGER)
+#define IS_STRING(v)  (((v) & BOX_MASK) == TAG_STRING)
+#define IS_OBJECT(v)  (((v) & BOX_MASK) == TAG_OBJ)
+
+#define AS_DOUBLE(v)  value_as_double(v)
+#define AS_INTEGER(v) ((long)((int64_t)((v) << 16) >> 16))
+#define AS_BOOLEAN(v) ((unsigned char)((v) & 1))
+#define AS_STRING(v)  ((char *)(uintptr_t)((v) & PAYLOAD_MASK))
+#define AS_OBJECT(v)  ((Object *)(uintptr_t)((v) & PAYLOAD_MASK))
+
+#define VALUE_TYPE(v) value_type(v)
+
+static inline double value_as_double(Value v) {
+    double d;
+    memcpy(&d, &v, sizeof d);
+    return d;
+}
+
+static inline unsigned int value_type(Value v) {
+    if (IS_DOUBLE(v)) {
+        return VAL_TYPE_DOUBLE;
+    }
+
+    switch (v & BOX_MASK) {
+    case TAG_BOOLEAN: return VAL_TYPE_BOOLEAN;
+    case TAG_INTEGER: return VAL_TYPE_INTEGER;
+    case TAG_STRING:  return VAL_TYPE_STRING;
+    case TAG_OBJ:     return VAL_TYPE_OBJ;
+    case QNAN:        return VAL_TYPE_UNDEFINED;
+    default:          return VAL_TYPE_NIL;
+    }
+}
+
+/**
+ * Creates a Value with type nil.
+ *
+ * @return A Value struct
+ */
+static inline Value nil_value() {
+    return TAG_NIL;
+}
+
+/**
+ * Creates the marker stored in global slots which haven't been defined yet.
+ * It is never visible to scripts.
+ *
+ * @return A Value struct
+ */
+static inline Value undefined_value() {
+    return QNAN;
+}
+
+/**
+ * Creates a Value with type double.
+ *
+ * @param x A double value.
+ * @return A Value struct
+ */
+static inline Value double_value(double x) {
+    Value v;
+    memcpy(&v, &x, sizeof v);
+    /* a NaN produced by arithmetic may collide with a boxed tag */
+    return (x != x) ? CANONICAL_NAN : v;
+}
+
+/**
+ * Creates a Value with type integer. Integers which don't fit into the 48-bit
+ * payload are stored as doubles instead.
+ *
+ * @param x An integer value.
+ * @return A Value struct.
+ */
+static inline Value int_value(long x) {
+    if (x < VALUE_INT_MIN || x > VALUE_INT_MAX) {
+        return double_value((double)x);
+    }
+    return TAG_INTEGER | ((uint64_t)x & PAYLOAD_MASK);
+}
+
+/**
+ * Creates a Value with type boolean. 1 for true, and 0 for false.
+ *
+ * @param bool 1 or 0
+ * @return A Value struct.
+ */
+static inline Value bool_value(char boolean) {
+    return TAG_BOOLEAN | (boolean != 0);
+}
+
+/**
+ * Creates a Value with type string which refers to x rather than a copy of it.
+ *
+ * @param x A char array.
+ * @return A Value struct.
+ */
+static inline Value string_ref_value(char *x) {
+    return TAG_STRING | ((uint64_t)(uintptr_t)x & PAYLOAD_MASK);
+}
+
+#else /* tagged union */
+
+typedef struct value Value;
+
 struct value {
     unsigned int type;
     union {
@@ -36,18 +182,49 @@ struct value {
     } as;
 };
 
-typedef struct {
-    Object obj;
-    unsigned int length;
-    char *chars;
-} string_obj;
+#define VALUE_INT_MAX LONG_MAX
+#define VALUE_INT_MIN LONG_MIN
+
+#define IS_DOUBLE(v)  ((v).type == VAL_TYPE_DOUBLE)
+#define IS_UNDEFINED(v) ((v).type == VAL_TYPE_UNDEFINED)
+#define IS_NIL(v)     ((v).type == VAL_TYPE_NIL)
+#define IS_BOOLEAN(v) ((v).type == VAL_TYPE_BOOLEAN)
+#define IS_INTEGER(v) ((v).type == VAL_TYPE_INTEGER)
+#define IS_STRING(v)  ((v).type == VAL_TYPE_STRING)
+#define IS_OBJECT(v)  ((v).type == VAL_TYPE_OBJ)
+
+#define AS_DOUBLE(v)  ((v).as.real)
+#define AS_INTEGER(v) ((v).as.integer)
+#define AS_BOOLEAN(v) ((v).as.boolean)
+#define AS_STRING(v)  ((v).as.string)
+#define AS_OBJECT(v)  ((v).as.obj)
+
+#define VALUE_TYPE(v) ((v).type)
 
 /**
  * Creates a Value with type nil.
  *
  * @return A Value struct
  */
-Value nil_value();
+static inline Value nil_value() {
+    Value v;
+    v.type = VAL_TYPE_NIL;
+    v.as.string = NULL;
+    return v;
+}
+
+/**
+ * Creates the marker stored in global slots which haven't been defined yet.
+ * It is never visible to scripts.
+ *
+ * @return A Value struct
+ */
+static inline Value undefined_value() {
+    Value v;
+    v.type = VAL_TYPE_UNDEFINED;
+    v.as.string = NULL;
+    return v;
+}
 
 /**
  * Creates a Value with type integer.
@@ -55,7 +232,12 @@ Value nil_value();
  * @param x An integer value.
  * @return A Value struct.
  */
-Value int_value(long x);
+static inline Value int_value(long x) {
+    Value v;
+    v.type = VAL_TYPE_INTEGER;
+    v.as.integer = x;
+    return v;
+}
 
 /**
  * Creates a Value with type double.
@@ -63,23 +245,48 @@ Value int_value(long x);
  * @param x A double value.
  * @return A Value struct
  */
-Value double_value(double x);
+static inline Value double_value(double x) {
+    Value v;
+    v.type = VAL_TYPE_DOUBLE;
+    v.as.real = x;
+    return v;
+}
 
 /**
- * Creates a Value with type string.
+ * Creates a Value with type boolean. 1 for true, and 0 for false.
+ *
+ * @param bool 1 or 0
+ * @return A Value struct.
+ */
+static inline Value bool_value(char boolean) {
+    Value v;
+    v.type = VAL_TYPE_BOOLEAN;
+    v.as.boolean = boolean;
+    return v;
+}
+
+/**
+ * Creates a Value with type string which refers to x rather than a copy of it.
  *
  * @param x A char array.
  * @return A Value struct.
  */
-Value string_value(char *x);
+static inline Value string_ref_value(char *x) {
+    Value v;
+    v.type = VAL_TYPE_STRING;
+    v.as.string = x;
+    return v;
+}
+
+#endif /* NAN_BOXING */
 
 /**
- * Creates a Value with type boolean. 1 for true, and 0 for false.
+ * Creates a Value with type string from a heap-allocated copy of x.
  *
- * @param bool 1 or 0
+ * @param x A char array.
  * @return A Value struct.
  */
-Value bool_value(char bool);
+Value string_value(char *x);
 
 /**
  * Creates a Value from two strings.
@@ -97,6 +304,4 @@ Value add_strings(Value *s1, Value *s2);
  */
 void print_value(Value *v);
 
-#define IS_OBJECT(value) value.type == VAL_TYPE_OBJ;
-
 #endif /* _VALUE_H_ */
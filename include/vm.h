@@ -2,9 +2,11 @@
 #ifndef _VM_H_
 #define _VM_H_
 
+#include "arena.h"
 #include "bytecode.h"
 #include "common.h"
 #include "error.h"
+#include "shared_table.h"
 #include "table.h"
 
 #define BINARY_OP(op)     \
@@ -20,18 +22,72 @@ typedef struct {
     Value *at;
 } Stack;
 
+/* Counters for how often evaluate() specialized a generic arithmetic opcode to
+ * its operand types (quickened) and how often a specialized opcode saw other
+ * types and was rewritten back (deoptimized). instructions counts dispatched
+ * instructions in either engine, but only when built with COUNT_INSTRUCTIONS
+ * since it costs an increment per dispatch. */
+typedef struct {
+    unsigned long quickened;
+    unsigned long deoptimized;
+    unsigned long instructions;
+} VMStats;
+
+typedef enum {
+    ENGINE_STACK,    /* OP_ bytecode run by execute() */
+    ENGINE_REGISTER, /* ROP_ register code run by execute_register() */
+} Engine;
+
+/* Runtime switches, set before the first call to execute(). */
+typedef struct {
+    unsigned int superinstructions; /* run fuse_superinstructions() before execute() */
+    Engine engine;
+} VMOptions;
+
+/* Globals live in dense slots indexed by the NameArray index the parser emits,
+ * so OP_GET_GLOBAL and friends never hash. env maps each defined name to its
+ * slot and is only touched on first definition and by get_global().
+ *
+ * symbols interns every identifier and string literal the parser sees, so
+ * equal names share one string. An identifier's symbol holds its index in
+ * names, which makes resolving a name at compile time a single lookup.
+ *
+ * shared, if set with attach_shared_globals(), is a scope shared with other
+ * VMs and threads. Reading a global the VM hasn't defined itself falls back to
+ * it, so every read of a shared global pays one table probe, with the name's
+ * hash and length taken from names rather than recomputed.
+ *
+ * compile_arena holds what run() builds to compile and execute one piece of
+ * source, its tokens and bytecode, and is reset once the code has run. Nothing
+ * which outlives the run, like symbols or globals, may point into it. */
 typedef struct {
     Stack stack;
+    HashTable *symbols;
     NameArray names;
+    ValueArray *globals;
     HashTable *env;
+    SharedTable *shared;
+    Arena compile_arena;
+    VMStats stats;
+    VMOptions options;
     int ip;
     int state;
 } VirtualMachine;
 
+/* Bytes held by each of a VM's data structures, see vm_memory_usage(). */
+typedef struct {
+    size_t env;
+    size_t symbols;
+    size_t globals;
+    size_t stack;
+    size_t compile_arena;
+} VMMemory;
+
 VirtualMachine initialize_vm();
 
 /**
  * Pushes a value onto the virtual machine stack and increments the stack head.
+ * The stack isn't bounds checked, space must be reserved with reserve_stack().
  *
  * @param s Pointer to the stack to push to
  * @param val Value to push onto the stack
@@ -47,9 +103,32 @@ void push(Stack *s, Value val);
  */
 Value pop(Stack *s);
 
+/**
+ * Grows the stack if necessary so that at least slots more values fit above
+ * its head.
+ *
+ * @param s Pointer to the stack to grow
+ * @param slots Number of values which will be pushed
+ * @return 1 on success, 0 if the stack couldn't be grown
+ */
+int reserve_stack(Stack *s, unsigned int slots);
+
+/**
+ * Releases stack memory grown by reserve_stack() which the values currently on
+ * the stack don't need, down to STACK_INITIAL_SIZE.
+ *
+ * @param s Pointer to the stack to shrink
+ */
+void shrink_stack(Stack *s);
+
 /**
  * Takes a virtual machine and an array of bytecode and executes the bytecode,
- * leaving the result on top of the virtual machine's stack.
+ * leaving the result on top of the virtual machine's stack. The bytecode must
+ * be terminated by OP_RETURN, which parse() always emits. The stack is grown
+ * once on entry to fit bytecode->max_stack values, so handlers don't check it.
+ *
+ * Opcodes are dispatched with a computed goto per handler when
+ * THREADED_DISPATCH is defined (see common.h), or with a switch otherwise.
  *
  * @param vm
  * @param bytecode
@@ -59,6 +138,7 @@ void evaluate(VirtualMachine *vm, BytecodeArray *bytecode);
 /**
  * Takes a virtual machine and an array of bytecode and executes the bytecode. If
  * there is a value left on the virtual machine's stack it pops and prints the value.
+ * Afterwards the stack is shrunk back if the bytecode needed to grow it.
  *
  * @param vm
  * @param bytecode
@@ -67,6 +147,81 @@ void evaluate(VirtualMachine *vm, BytecodeArray *bytecode);
 unsigned int execute(VirtualMachine *vm, BytecodeArray *bytecode);
 void free_vm(VirtualMachine *vm);
 
+/**
+ * Looks up a global variable by name. This goes through the env hash table,
+ * so it is meant for introspection rather than for the interpreter loop.
+ *
+ * @param vm The virtual machine the global is defined in.
+ * @param name The name of the global.
+ * @return A pointer to the global's slot, or NULL if it isn't defined.
+ */
+Value *get_global(VirtualMachine *vm, char *name);
+
+/**
+ * Makes the globals in shared readable by code the VM runs, behind any the VM
+ * defines itself. Scripts can't assign to shared globals, only shadow them.
+ * The VM doesn't take ownership of shared, which must outlive it.
+ *
+ * @param vm The virtual machine to attach the scope to.
+ * @param shared The shared scope, or NULL to detach it.
+ */
+void attach_shared_globals(VirtualMachine *vm, SharedTable *shared);
+
+/**
+ * Looks up the global in slot in the VM's shared scope, for when the VM hasn't
+ * defined it.
+ *
+ * @param vm The virtual machine running the code.
+ * @param slot The global's slot, its index in vm->names.
+ * @param value Set to the shared global's value if it is found.
+ * @return 1 if the shared scope defines the global, 0 otherwise.
+ */
+int get_shared_global(VirtualMachine *vm, unsigned int slot, Value *value);
+
+/**
+ * Grows vm->globals so that every name in vm->names has a slot. Must be called
+ * before running code compiled against vm.
+ *
+ * @param vm
+ */
+void reserve_globals(VirtualMachine *vm);
+
+/**
+ * Stores a value in a global slot, adding the name to vm->env the first time
+ * the slot is defined.
+ *
+ * @param vm
+ * @param slot The NameArray index of the global.
+ * @param value The value to store.
+ */
+void define_global(VirtualMachine *vm, unsigned int slot, Value value);
+
+/**
+ * Measures the memory the VM's env and symbol tables, globals, stack and
+ * compile arena hold, for embedders to report. Keys, strings and bytecode aren't counted.
+ *
+ * @param vm
+ * @param memory Filled in with the size of each structure in bytes.
+ */
+void vm_memory_usage(VirtualMachine *vm, VMMemory *memory);
+
+/**
+ * Gives back memory a long running VM no longer needs: its env and symbol
+ * tables are compacted with table_compact(), its stack is shrunk and its
+ * compile arena is freed. Mustn't be called while code from the arena runs.
+ *
+ * @param vm
+ */
+void compact_vm(VirtualMachine *vm);
+
+/**
+ * Prints the virtual machine's quickening and instruction counters, and the
+ * shape and footprint of its env table.
+ *
+ * @param vm
+ */
+void print_vm_stats(VirtualMachine *vm);
+
 #ifdef DEBUG_VM
 void print_disassembly(BytecodeArray *bytecode);
 void print_stack(VirtualMachine *vm);
@@ -2,25 +2,101 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "function.h"
 #include "table.h"
 
 /* value functions */
 
-#define FNV1_32_INIT 2166136261u
-#define FNV1_32_PRIME 16777619u
+/* A wyhash style hash, the same as motmot's src/hash.c: keys are consumed 8
+ * bytes at a time, and the seed is picked randomly per process. */
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+#define HASH_P3 0x589965cc75374cc3ull
+
+static uint64_t hash_seed;
+
+__attribute__((constructor))
+static void init_hash_seed() {
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (fp != NULL) {
+        size_t read = fread(&hash_seed, sizeof hash_seed, 1, fp);
+        fclose(fp);
+        if (read == 1) {
+            return;
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    hash_seed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16);
+}
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
 
 static uint32_t hash_string_n(const char *string, unsigned int length) {
-    static const uint32_t prime = FNV1_32_PRIME;
-    uint32_t hash = FNV1_32_INIT;
+    const uint8_t *p = (const uint8_t *)string;
+    uint64_t seed = hash_seed ^ hash_mix(hash_seed ^ HASH_P0, HASH_P1);
+    uint64_t a, b;
+
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t offset = (length >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + offset);
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - offset);
+        } else if (length > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t remaining = length;
+
+        if (remaining > 48) {
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            do {
+                seed = hash_mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+                lane1 = hash_mix(read64(p + 16) ^ HASH_P2, read64(p + 24) ^ lane1);
+                lane2 = hash_mix(read64(p + 32) ^ HASH_P3, read64(p + 40) ^ lane2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= lane1 ^ lane2;
+        }
+
+        while (remaining > 16) {
+            seed = hash_mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
 
-    for (unsigned int i = 0; i < length; i++) {
-        hash ^= string[i];
-        hash *= prime;
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
     }
 
-    return hash;
+    __uint128_t product = (__uint128_t)(a ^ HASH_P1) * (b ^ seed);
+    uint64_t hash = hash_mix((uint64_t)product ^ HASH_P0 ^ length, (uint64_t)(product >> 64) ^ HASH_P1);
+    return (uint32_t)(hash ^ (hash >> 32));
 }
 
 static uint32_t hash_string(const char *string) {
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+static ArenaBlock *allocate_block(size_t size) {
+    ArenaBlock *block = malloc(sizeof *block + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/* offset of the first aligned address at or after the block's used bytes */
+static inline size_t aligned_offset(ArenaBlock *block) {
+    uintptr_t address = (uintptr_t)(block->data + block->used);
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+    return block->used + (aligned - address);
+}
+
+void init_arena(Arena *arena, size_t block_size) {
+    arena->blocks = NULL;
+    arena->block_size = block_size;
+    arena->last = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    if (arena == NULL) {
+        return malloc(size);
+    }
+
+    ArenaBlock *block = arena->blocks;
+    size_t offset = block != NULL ? aligned_offset(block) : 0;
+
+    if (block == NULL || offset + size > block->size) {
+        size_t block_size = block != NULL ? block->size * 2 : arena->block_size;
+        while (block_size < size + ARENA_ALIGNMENT) {
+            block_size *= 2;
+        }
+
+        ArenaBlock *fresh = allocate_block(block_size);
+        fresh->next = block;
+        arena->blocks = block = fresh;
+        offset = aligned_offset(block);
+    }
+
+    block->used = offset + size;
+    arena->last = block->data + offset;
+    return arena->last;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (arena == NULL) {
+        return realloc(ptr, new_size);
+    }
+
+    ArenaBlock *block = arena->blocks;
+    if (ptr != NULL && ptr == arena->last) {
+        size_t offset = (unsigned char *)ptr - block->data;
+        if (offset + new_size <= block->size) {
+            block->used = offset + new_size;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (ptr != NULL) {
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return moved;
+}
+
+void arena_free(Arena *arena, void *ptr) {
+    if (arena == NULL) {
+        free(ptr);
+    }
+}
+
+void reset_arena(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL) {
+        return;
+    }
+
+    /* a single block is simply reused, several are merged into one */
+    if (block->next != NULL) {
+        size_t total = 0;
+        while (block != NULL) {
+            ArenaBlock *next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        arena->blocks = block = allocate_block(total);
+    }
+
+    block->used = 0;
+    arena->last = NULL;
+}
+
+size_t arena_memory_usage(Arena *arena) {
+    size_t total = 0;
+    for (ArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+        total += sizeof *block + block->size;
+    }
+    return total;
+}
+
+void free_arena(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->last = NULL;
+}
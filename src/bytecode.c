@@ -4,49 +4,53 @@
 
 #include "bytecode.h"
 
-static void grow_bytecode_array(BytecodeArray *array, unsigned int new_size) {
-    array->array = realloc(array->array, new_size);
+static void grow_bytecode_array(BytecodeArray *array, unsigned int old_size, unsigned int new_size) {
+    array->array = arena_realloc(array->arena, array->array, old_size, new_size);
     if (array->array == NULL) {
         fputs("error: unable to realloc array\n", stderr);
     }
 }
 
 /* value array */
-static void grow_value_array(ValueArray *array, unsigned int new_size) {
+static unsigned int grow_value_array(ValueArray *array, unsigned int old_size, unsigned int new_size) {
     if (new_size > MAX_CHUNK_CONSTANTS) {
-        fputs("error: constants overflow\n", stderr);
-        return;
+        return 0;
     }
 
-    array->array = realloc(array->array, new_size * (sizeof *array->array));
+    array->array = arena_realloc(array->arena, array->array, old_size * (sizeof *array->array),
+            new_size * (sizeof *array->array));
     if (array->array == NULL) {
         fputs("error: unable to realloc array\n", stderr);
+        return 0;
     }
+    array->capacity = new_size;
+    return 1;
 }
 
-ValueArray *create_value_dynarray() {
-    ValueArray *array = malloc(sizeof *array);
+ValueArray *create_value_dynarray(Arena *arena) {
+    ValueArray *array = arena_alloc(arena, sizeof *array);
+    array->arena = arena;
     array->elements = 0;
     array->capacity = DYNARRAY_INITIAL_SIZE;
-    array->array = malloc(DYNARRAY_INITIAL_SIZE * (sizeof *array->array));
+    array->array = arena_alloc(arena, DYNARRAY_INITIAL_SIZE * (sizeof *array->array));
     return array;
 }
 
-void append_to_value_dynarray(ValueArray *array, Value val) {
-    if (array->elements == array->capacity) {
-        array->capacity *= DYNARRAY_GROW_BY_FACTOR;
-        grow_value_array(array, array->capacity);
-
-        if (array->array == NULL) {
-            printf("got NULL while performing array realloc\n");
-            return;
-        }
+unsigned int append_to_value_dynarray(ValueArray *array, Value val) {
+    if (array->elements == array->capacity
+            && !grow_value_array(array, array->elements, array->capacity * DYNARRAY_GROW_BY_FACTOR)) {
+        return 0;
     }
 
     array->array[array->elements++] = val;
+    return 1;
 }
 
 void free_value_dynarray(ValueArray *array) {
+    if (array->arena != NULL) {
+        return;
+    }
+
     free(array->array);
     array->array = NULL;
     free(array);
@@ -54,23 +58,31 @@ void free_value_dynarray(ValueArray *array) {
 }
 
 /* names array */
-static void grow_name_array(NameArray *array, unsigned int new_size) {
+static unsigned int grow_name_array(NameArray *array, unsigned int new_size) {
     if (new_size > MAX_CHUNK_NAMES) {
-        fputs("error: names overflow\n", stderr);
-        return;
+        return 0;
     }
 
-    char **old_array = array->array;
-    array->array = calloc(sizeof *array->array, new_size);
-    if (array->array == NULL) {
+    char **new_array = calloc(sizeof *array->array, new_size);
+    NameKey *new_keys = calloc(sizeof *array->keys, new_size);
+    if (new_array == NULL || new_keys == NULL) {
         fputs("error: unable to realloc array\n", stderr);
+        free(new_array);
+        free(new_keys);
+        return 0;
     }
 
     for (unsigned int i = 0; i < array->elements; i++) {
-        array->array[i] = old_array[i];
+        new_array[i] = array->array[i];
+        new_keys[i] = array->keys[i];
     }
 
-    free(old_array);
+    free(array->array);
+    free(array->keys);
+    array->array = new_array;
+    array->keys = new_keys;
+    array->capacity = new_size;
+    return 1;
 }
 
 NameArray create_name_dynarray() {
@@ -78,45 +90,38 @@ NameArray create_name_dynarray() {
     array.elements = 0;
     array.capacity = DYNARRAY_INITIAL_SIZE;
     array.array = calloc(DYNARRAY_INITIAL_SIZE, (sizeof *array.array));
+    array.keys = calloc(DYNARRAY_INITIAL_SIZE, (sizeof *array.keys));
     return array;
 }
 
-void append_to_name_dynarray(NameArray *array, char *val) {
-    if (array->elements == array->capacity) {
-        array->capacity *= DYNARRAY_GROW_BY_FACTOR;
-        grow_name_array(array, array->capacity);
-
-        if (array->array == NULL) {
-            printf("got NULL while performing array realloc\n");
-            return;
-        }
+unsigned int append_to_name_dynarray(NameArray *array, char *val, uint32_t hash, uint32_t length) {
+    if (array->elements == array->capacity
+            && !grow_name_array(array, array->capacity * DYNARRAY_GROW_BY_FACTOR)) {
+        return 0;
     }
 
-    unsigned int len = strlen(val);
-    array->array[array->elements] = malloc(len + 1);
-    memcpy(array->array[array->elements], val, len);
-    array->array[array->elements][len] = '\0';
-    array->elements++;
+    array->keys[array->elements] = (NameKey) { hash, length };
+    array->array[array->elements++] = val;
+    return 1;
 }
 
 void free_name_dynarray(NameArray *array) {
-    for (unsigned int i = 0; i < array->elements; i++) {
-        free(array->array[i]);
-        array->array[i] = NULL;
-    }
-
     free(array->array);
+    free(array->keys);
     array->array = NULL;
+    array->keys = NULL;
 }
 
 /* bytecode chunk */
-BytecodeArray *create_bytecode_dynarray() {
-    BytecodeArray *array = malloc(sizeof *array);
+BytecodeArray *create_bytecode_dynarray(Arena *arena) {
+    BytecodeArray *array = arena_alloc(arena, sizeof *array);
+    array->arena = arena;
     array->elements = 0;
     array->capacity = DYNARRAY_INITIAL_SIZE;
-    array->array = malloc(sizeof(uint8_t) * DYNARRAY_INITIAL_SIZE);
-    array->constants = create_value_dynarray();
+    array->array = arena_alloc(arena, sizeof(uint8_t) * DYNARRAY_INITIAL_SIZE);
+    array->constants = create_value_dynarray(arena);
     array->names = NULL;
+    array->max_stack = 0;
     // array.names = create_name_dynarray(); // handled by vm
     return array;
 }
@@ -124,7 +129,7 @@ BytecodeArray *create_bytecode_dynarray() {
 void append_to_bytecode_dynarray(BytecodeArray *array, opcode_t op) {
     if (array->elements == array->capacity) {
         array->capacity *= DYNARRAY_GROW_BY_FACTOR;
-        grow_bytecode_array(array, array->capacity);
+        grow_bytecode_array(array, array->elements, array->capacity);
 
         if (array->array == NULL) {
             printf("got NULL while performing array realloc\n");
@@ -148,6 +153,10 @@ opcode_t *next_opcode(BytecodeArray *array, ArrayIterator *iter) {
 }
 
 void free_bytecode_dynarray(BytecodeArray *array) {
+    if (array->arena != NULL) {
+        return;
+    }
+
     free_value_dynarray(array->constants);
     // free_name_dynarray(&array->names); // handled by vm
     free(array->array);
@@ -158,17 +167,43 @@ void free_bytecode_dynarray(BytecodeArray *array) {
 }
 
 #ifdef DEBUG_COMPILER
-static void print_opcode(opcode_t opcode) {
-    switch(opcode) {
-    case OP_RETURN: printf("%02x RETURN\n", opcode); break;
-    case OP_CONSTANT: printf("%02x CONSTANT\n", opcode); break;
-    case OP_GET_GLOBAL: printf("%02x GET_GLOBAL\n", opcode); break;
-    case OP_SET_GLOBAL: printf("%02x SET_GLOBAL\n", opcode); break;
-    case OP_ADD: printf("%02x ADD\n", opcode); break;
-    case OP_SUB: printf("%02x SUB\n", opcode); break;
-    case OP_MULT: printf("%02x MULT\n", opcode); break;
-    case OP_DIV: printf("%02x DIV\n", opcode); break;
-    default: printf("%02x UNKNOWN\n", opcode); break;
+static void print_opcode(opcode_t op) {
+    switch(op) {
+    case OP_RETURN: printf("%02x RETURN\n", op); break;
+    case OP_CONSTANT: printf("%02x CONSTANT\n", op); break;
+    case OP_GET_GLOBAL: printf("%02x GET_GLOBAL\n", op); break;
+    case OP_SET_GLOBAL: printf("%02x SET_GLOBAL\n", op); break;
+    case OP_UPDATE_GLOBAL: printf("%02x UPDATE_GLOBAL\n", op); break;
+    case OP_ADD: printf("%02x ADD\n", op); break;
+    case OP_SUB: printf("%02x SUB\n", op); break;
+    case OP_MULT: printf("%02x MULT\n", op); break;
+    case OP_DIV: printf("%02x DIV\n", op); break;
+    case OP_CMP: printf("%02x CMP\n", op); break;
+    case OP_NEGATE: printf("%02x NEGATE\n", op); break;
+    case OP_ADD_DD: printf("%02x ADD_DD\n", op); break;
+    case OP_ADD_II: printf("%02x ADD_II\n", op); break;
+    case OP_ADD_SS: printf("%02x ADD_SS\n", op); break;
+    case OP_SUB_DD: printf("%02x SUB_DD\n", op); break;
+    case OP_SUB_II: printf("%02x SUB_II\n", op); break;
+    case OP_MULT_DD: printf("%02x MULT_DD\n", op); break;
+    case OP_MULT_II: printf("%02x MULT_II\n", op); break;
+    case OP_DIV_DD: printf("%02x DIV_DD\n", op); break;
+    case OP_DIV_II: printf("%02x DIV_II\n", op); break;
+    case OP_ADD_CONST: printf("%02x ADD_CONST\n", op); break;
+    case OP_SUB_CONST: printf("%02x SUB_CONST\n", op); break;
+    case OP_MULT_CONST: printf("%02x MULT_CONST\n", op); break;
+    case OP_DIV_CONST: printf("%02x DIV_CONST\n", op); break;
+    case OP_CMP_CONST: printf("%02x CMP_CONST\n", op); break;
+    case OP_GET_GLOBAL2: printf("%02x GET_GLOBAL2\n", op); break;
+    case OP_ADD_CONST_DD: printf("%02x ADD_CONST_DD\n", op); break;
+    case OP_ADD_CONST_II: printf("%02x ADD_CONST_II\n", op); break;
+    case OP_SUB_CONST_DD: printf("%02x SUB_CONST_DD\n", op); break;
+    case OP_SUB_CONST_II: printf("%02x SUB_CONST_II\n", op); break;
+    case OP_MULT_CONST_DD: printf("%02x MULT_CONST_DD\n", op); break;
+    case OP_MULT_CONST_II: printf("%02x MULT_CONST_II\n", op); break;
+    case OP_DIV_CONST_DD: printf("%02x DIV_CONST_DD\n", op); break;
+    case OP_DIV_CONST_II: printf("%02x DIV_CONST_II\n", op); break;
+    default: printf("%02x UNKNOWN\n", op); break;
     }
 }
 
@@ -215,6 +250,44 @@ void print_disassembly(BytecodeArray *bytecode) {
             printf("%02x SET_GLOBAL (%s)\n", op, bytecode->names->array[bytecode->array[i + 1]]);
             i++;
             break;
+        case OP_ADD_CONST:
+        case OP_SUB_CONST:
+        case OP_MULT_CONST:
+        case OP_DIV_CONST:
+        case OP_CMP_CONST:
+            v = &bytecode->constants->array[bytecode->array[i + 1]];
+            printf("%02x %s_CONST (", op, op == OP_ADD_CONST ? "ADD"
+                    : op == OP_SUB_CONST ? "SUB"
+                    : op == OP_MULT_CONST ? "MULT"
+                    : op == OP_DIV_CONST ? "DIV" : "CMP");
+            print_value(v);
+            printf(")\n");
+            i++;
+            break;
+        case OP_ADD_CONST_DD:
+        case OP_ADD_CONST_II:
+        case OP_SUB_CONST_DD:
+        case OP_SUB_CONST_II:
+        case OP_MULT_CONST_DD:
+        case OP_MULT_CONST_II:
+        case OP_DIV_CONST_DD:
+        case OP_DIV_CONST_II:
+            v = &bytecode->constants->array[bytecode->array[i + 1]];
+            printf("%02x %s_CONST_%s (", op,
+                    op <= OP_ADD_CONST_II ? "ADD"
+                    : op <= OP_SUB_CONST_II ? "SUB"
+                    : op <= OP_MULT_CONST_II ? "MULT" : "DIV",
+                    (op - OP_ADD_CONST_DD) % 2 ? "II" : "DD");
+            print_value(v);
+            printf(")\n");
+            i++;
+            break;
+        case OP_GET_GLOBAL2:
+            printf("%02x GET_GLOBAL2 (%s, %s)\n", op,
+                    bytecode->names->array[bytecode->array[i + 1]],
+                    bytecode->names->array[bytecode->array[i + 2]]);
+            i += 2;
+            break;
         default:
             print_opcode(bytecode->array[i]);
         }
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+#define HASH_P3 0x589965cc75374cc3ull
+
+static uint64_t hash_seed;
+
+/* the seed comes from /dev/urandom, or from the clock and pid if it can't be
+ * read, and is set before main() so every table in the process agrees */
+__attribute__((constructor))
+static void init_hash_seed() {
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (fp != NULL) {
+        size_t read = fread(&hash_seed, sizeof hash_seed, 1, fp);
+        fclose(fp);
+        if (read == 1) {
+            return;
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    hash_seed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16);
+}
+
+/* multiplies a and b into 128 bits and folds the halves together */
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+/* reads 1 to 3 bytes */
+static inline uint64_t read_small(const uint8_t *p, size_t length) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+}
+
+uint64_t hash_bytes_seeded(const void *bytes, size_t length, uint64_t seed) {
+    const uint8_t *p = bytes;
+    uint64_t a, b;
+
+    seed ^= mix(seed ^ HASH_P0, HASH_P1);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            /* two overlapping pairs of 4 byte reads cover 4 to 16 bytes */
+            size_t offset = (length >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + offset);
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - offset);
+        } else if (length > 0) {
+            a = read_small(p, length);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t remaining = length;
+
+        if (remaining > 48) {
+            /* three independent lanes so the multiplies can overlap */
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            do {
+                seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+                lane1 = mix(read64(p + 16) ^ HASH_P2, read64(p + 24) ^ lane1);
+                lane2 = mix(read64(p + 32) ^ HASH_P3, read64(p + 40) ^ lane2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= lane1 ^ lane2;
+        }
+
+        while (remaining > 16) {
+            seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        /* the last 16 bytes, overlapping what was already mixed */
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+
+    __uint128_t product = (__uint128_t)(a ^ HASH_P1) * (b ^ seed);
+    a = (uint64_t)product;
+    b = (uint64_t)(product >> 64);
+    return mix(a ^ HASH_P0 ^ length, b ^ HASH_P1);
+}
+
+uint32_t hash_bytes(const void *bytes, size_t length) {
+    uint64_t hash = hash_bytes_seeded(bytes, length, hash_seed);
+    return (uint32_t)(hash ^ (hash >> 32));
+}
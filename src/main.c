@@ -1,13 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "common.h"
 #include "bytecode.h"
 #include "tokenize.h"
+#include "optimize.h"
 #include "parser.h"
+#include "register_vm.h"
 #include "vm.h"
 #include "table.h"
 
+static unsigned int show_stats = 0;
+static VMOptions options = { 1, ENGINE_STACK };
+
 unsigned long get_file_size(FILE *fp) {
     if (fp == NULL) {
         return 0L;
@@ -20,15 +26,45 @@ unsigned long get_file_size(FILE *fp) {
     return file_size;
 }
 
-int run(VirtualMachine *vm, char *source) {
-    TokenArray *tokens = tokenize(source);
+static int run_register(VirtualMachine *vm, char *source) {
+    RegisterCode *code = parse_register_source(vm, source);
+    if (code == NULL) {
+        return 1;
+    }
+
+    #ifdef DEBUG_COMPILER
+    print_register_disassembly(code);
+    #endif
 
+    execute_register(vm, code);
+    free_register_code(code);
+
+    return 0;
+}
+
+/* source is lexed as it is compiled, in one pass. the bytecode lives in
+ * vm->compile_arena until it has run, then the arena is reset for the next
+ * call */
+int run(VirtualMachine *vm, char *source) {
     #ifdef DEBUG_TOKENS
-    print_tokens(tokens);
+    print_tokens(tokenize_in(&vm->compile_arena, source));
     #endif
 
-    BytecodeArray *bytecode = parse(vm, tokens);
-    free_array(tokens);
+    if (vm->options.engine == ENGINE_REGISTER) {
+        run_register(vm, source);
+        reset_arena(&vm->compile_arena);
+        return 0;
+    }
+
+    BytecodeArray *bytecode = parse_source(vm, source, &vm->compile_arena);
+    if (bytecode == NULL) {
+        reset_arena(&vm->compile_arena);
+        return 1;
+    }
+
+    if (vm->options.superinstructions) {
+        fuse_superinstructions(bytecode);
+    }
 
     #ifdef DEBUG_COMPILER
     print_disassembly(bytecode);
@@ -43,12 +79,14 @@ int run(VirtualMachine *vm, char *source) {
     #endif
 
     free_bytecode_dynarray(bytecode);
+    reset_arena(&vm->compile_arena);
 
     return 0;
 }
 
 int run_interactive() {
     VirtualMachine vm = initialize_vm();
+    vm.options = options;
 #ifdef MAJOR_VERS
     printf("Motmot v%d.%d ", MAJOR_VERS, MINOR_VERS);
 #endif
@@ -65,6 +103,9 @@ int run_interactive() {
         run(&vm, input);
     }
 
+    if (show_stats) {
+        print_vm_stats(&vm);
+    }
     free_vm(&vm);
     return 0;
 }
@@ -88,31 +129,55 @@ int run_file(char *filename) {
     source[file_size] = '\0';
 
     vm = initialize_vm();
+    vm.options = options;
     run(&vm, source);
 
     fclose(fp);
     free(source);
+    if (show_stats) {
+        print_vm_stats(&vm);
+    }
     free_vm(&vm);
     return 0;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc == 1) {
+    char *filename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--no-superinstructions") == 0) {
+            options.superinstructions = 0;
+        } else if (strcmp(argv[i], "--engine=stack") == 0) {
+            options.engine = ENGINE_STACK;
+        } else if (strcmp(argv[i], "--engine=register") == 0) {
+            options.engine = ENGINE_REGISTER;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 0;
+        } else if (filename == NULL) {
+            filename = argv[i];
+        } else {
+            fprintf(stderr, "Too many arguments\n");
+            return 0;
+        }
+    }
+
+    if (filename == NULL) {
         /* interactive mode */
         int error = run_interactive();
 
         if (error != 0) {
             fprintf(stderr, "errors occurred.\n");
         }
-    } else if (argc == 2) {
+    } else {
         /* execute file */
-        int error = run_file(argv[1]);
+        int error = run_file(filename);
 
         if (error != 0) {
-            fprintf(stderr, "Error executing file: '%s'\n", argv[1]);
+            fprintf(stderr, "Error executing file: '%s'\n", filename);
         }
-    } else {
-        fprintf(stderr, "Too many arguments\n");
     }
 
     return 0;
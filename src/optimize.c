@@ -0,0 +1,73 @@
+#include "optimize.h"
+
+unsigned int instruction_length(opcode_t op) {
+    switch (op) {
+    case OP_CONSTANT:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_UPDATE_GLOBAL:
+    case OP_ADD_CONST:
+    case OP_SUB_CONST:
+    case OP_MULT_CONST:
+    case OP_DIV_CONST:
+    case OP_CMP_CONST:
+    case OP_ADD_CONST_DD:
+    case OP_ADD_CONST_II:
+    case OP_SUB_CONST_DD:
+    case OP_SUB_CONST_II:
+    case OP_MULT_CONST_DD:
+    case OP_MULT_CONST_II:
+    case OP_DIV_CONST_DD:
+    case OP_DIV_CONST_II:
+        return 2;
+    case OP_GET_GLOBAL2:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/* returns the superinstruction for OP_CONSTANT followed by op, or OP_RETURN if
+ * there is none */
+static opcode_t fuse_constant(opcode_t op) {
+    switch (op) {
+    case OP_ADD:  return OP_ADD_CONST;
+    case OP_SUB:  return OP_SUB_CONST;
+    case OP_MULT: return OP_MULT_CONST;
+    case OP_DIV:  return OP_DIV_CONST;
+    case OP_CMP:  return OP_CMP_CONST;
+    default:      return OP_RETURN;
+    }
+}
+
+void fuse_superinstructions(BytecodeArray *bytecode) {
+    uint8_t *code = bytecode->array;
+    unsigned int length = bytecode->elements;
+    unsigned int in = 0;
+    unsigned int out = 0;
+
+    while (in < length) {
+        opcode_t op = code[in];
+        unsigned int op_length = instruction_length(op);
+        unsigned int next = in + op_length;
+        opcode_t fused;
+
+        if (op == OP_CONSTANT && next < length
+                && (fused = fuse_constant(code[next])) != OP_RETURN) {
+            code[out++] = fused;
+            code[out++] = code[in + 1];
+            in = next + 1;
+        } else if (op == OP_GET_GLOBAL && next < length && code[next] == OP_GET_GLOBAL) {
+            code[out++] = OP_GET_GLOBAL2;
+            code[out++] = code[in + 1];
+            code[out++] = code[next + 1];
+            in = next + 2;
+        } else {
+            for (unsigned int i = 0; i < op_length; i++) {
+                code[out++] = code[in++];
+            }
+        }
+    }
+
+    bytecode->elements = out;
+}
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,46 +6,123 @@
 #include "parser.h"
 
 /* private functions */
+static void advance(ParserState*);
 static void assignment(ParserState*);
 static void binary(ParserState*);
+static void error_token(ParserState*);
 static void expression(ParserState*);
 static void grouping(ParserState*);
 static void identifier(ParserState*);
 static void number(ParserState*);
 static void string(ParserState*);
 static void unary(ParserState*);
+static void emit_return(ParserState*);
+
+/* the parser starts out without a token source, the caller sets lexer or
+ * tokens before compiling */
+static void init_parser(ParserState *s, VirtualMachine *vm, const char *source) {
+    s->source = source;
+    s->current = NULL;
+    s->prev = NULL;
+    s->lexer = NULL;
+    s->tokens = NULL;
+    s->read = 0;
+    s->bytecode = NULL;
+    s->regcode = NULL;
+    s->symbols = vm->symbols;
+    s->names = &vm->names;
+    s->constants = NULL;
+    s->operand_count = 0;
+    s->next_register = 0;
+    s->depth = 0;
+    s->error = 0;
+}
 
-BytecodeArray *parse(VirtualMachine *vm, TokenArray *tokens) {
-    ArrayIterator iter = { tokens->count, 0 };
-    BytecodeArray *bytecode = create_bytecode_dynarray();
-    bytecode->names = &vm->names;
-
-    ParserState s;
-    s.current = tokens->tokens;
-    s.prev = NULL;
-    s.bytecode = bytecode;
-    s.iter = &iter;
-    s.error = 0;
+static BytecodeArray *compile(ParserState *s, Arena *arena) {
+    BytecodeArray *bytecode = create_bytecode_dynarray(arena);
+    bytecode->names = s->names;
+    s->bytecode = bytecode;
+    s->constants = bytecode->constants;
 
-    expression(&s);
-    // statement(&s);
+    advance(s);
+    expression(s);
+    // statement(s);
+    emit_return(s);
 
     #ifdef DEBUG_PARSER
-    printf("index at %ld out of %d\n", s.current - tokens->tokens, tokens->count);
+    printf("read %u tokens\n", s->read);
     #endif
 
+    if (s->error) {
+        free_bytecode_dynarray(bytecode);
+        return NULL;
+    }
+
     return bytecode;
 }
 
+static RegisterCode *compile_register(ParserState *s) {
+    RegisterCode *code = create_register_code();
+    code->names = s->names;
+    s->regcode = code;
+    s->constants = code->constants;
+
+    advance(s);
+    expression(s);
+    emit_return(s);
+
+    if (s->error) {
+        free_register_code(code);
+        return NULL;
+    }
+
+    return code;
+}
+
+BytecodeArray *parse(VirtualMachine *vm, TokenArray *tokens) {
+    ParserState s;
+    init_parser(&s, vm, tokens->source);
+    s.tokens = tokens;
+    return compile(&s, tokens->arena);
+}
+
+RegisterCode *parse_register(VirtualMachine *vm, TokenArray *tokens) {
+    ParserState s;
+    init_parser(&s, vm, tokens->source);
+    s.tokens = tokens;
+    return compile_register(&s);
+}
+
+BytecodeArray *parse_source(VirtualMachine *vm, const char *source, Arena *arena) {
+    Lexer lexer;
+    init_lexer(&lexer, source);
+
+    ParserState s;
+    init_parser(&s, vm, source);
+    s.lexer = &lexer;
+    return compile(&s, arena);
+}
+
+RegisterCode *parse_register_source(VirtualMachine *vm, const char *source) {
+    Lexer lexer;
+    init_lexer(&lexer, source);
+
+    ParserState s;
+    init_parser(&s, vm, source);
+    s.lexer = &lexer;
+    return compile_register(&s);
+}
+
 /* private functions */
 const static Rule rules[] = {
     [T_NONE]         = { NULL,       NULL,   PREC_NONE },
     [T_EOF]          = { NULL,       NULL,   PREC_NONE },
-    [T_ERROR]        = { NULL,       NULL,   PREC_NONE },
+    [T_ERROR]        = { error_token, NULL,  PREC_NONE },
     [T_NIL]          = { NULL,       NULL,   PREC_NONE },
     [T_IDENTIFIER]   = { identifier, NULL,   PREC_NONE },
     [T_STRING]       = { string,     NULL,   PREC_NONE },
     [T_NUMBER]       = { number,     NULL,   PREC_NONE },
+    [T_INTEGER]      = { number,     NULL,   PREC_NONE },
     [T_BOOLEAN]      = { NULL,       NULL,   PREC_NONE },
     [T_AND]          = { NULL,       NULL,   PREC_NONE },
     [T_OR]           = { NULL,       NULL,   PREC_NONE },
@@ -96,9 +174,24 @@ static const Rule *const get_rule(Token *token) {
     return &rules[token->type];
 }
 
+/* a token array ends with T_EOF, which is repeated if the parser reads on */
+static Token next_token_from(ParserState *parser) {
+    if (parser->lexer != NULL) {
+        return lex_token(parser->lexer);
+    }
+
+    TokenArray *tokens = parser->tokens;
+    unsigned int index = parser->read < tokens->count ? parser->read : tokens->count - 1;
+    return tokens->tokens[index];
+}
+
 static void advance(ParserState *parser) {
+    Token *slot = &parser->ring[parser->read & (PARSER_RING_SIZE - 1)];
+    *slot = next_token_from(parser);
+    parser->read++;
+
     parser->prev = parser->current;
-    parser->current++;
+    parser->current = slot;
 }
 
 static int expect(ParserState *parser, TokenType type) {
@@ -113,53 +206,196 @@ static int at_end(ParserState *parser) {
     return parser->current->type == T_EOF;
 }
 
-static void index_of(NameArray *names, char *str, int *ind) {
-    for (unsigned int i = 0; i < names->elements; i++) {
-        if (strcmp(names->array[i], str) == 0) {
-            *ind = i;
-            return;
+/* the first time a symbol is used as a name it is given the next index in
+ * names, which the symbol then remembers */
+static unsigned int name_index(ParserState *parser, Token *name) {
+    Entry *symbol = intern_entry(parser->symbols, parser->source + name->offset, name->length);
+
+    if (IS_NIL(symbol->value)) {
+        if (!append_to_name_dynarray(parser->names, symbol->key, symbol->hash, symbol->length)) {
+            if (!parser->error) {
+                report_error("SyntaxError", "Too many names");
+            }
+            parser->error = 1;
+            return 0;
+        }
+        symbol->value = int_value(parser->names->elements - 1);
+    }
+
+    return AS_INTEGER(symbol->value);
+}
+
+/* like register numbers, a constant that doesn't fit in the operand byte
+ * rejects the code and index 0 stands in until compiling ends */
+static unsigned int constant_index(ParserState *parser, Value val) {
+    if (!append_to_value_dynarray(parser->constants, val)) {
+        if (!parser->error) {
+            report_error("SyntaxError", "Too many constants");
+        }
+        parser->error = 1;
+        return 0;
+    }
+    return parser->constants->elements - 1;
+}
+
+/* register code operands */
+static void push_operand(ParserState *parser, uint16_t rk) {
+    if (parser->operand_count == MAX_REGISTERS) {
+        if (!parser->error) {
+            report_error("SyntaxError", "Expression too complex");
+        }
+        parser->error = 1;
+        return;
+    }
+    parser->operands[parser->operand_count++] = rk;
+}
+
+static uint16_t pop_operand(ParserState *parser) {
+    if (parser->operand_count == 0) {
+        parser->error = 1;
+        return RK_CONSTANT;
+    }
+
+    uint16_t rk = parser->operands[--parser->operand_count];
+    if (!(rk & RK_CONSTANT) && rk == parser->next_register - 1) {
+        parser->next_register--;
+    }
+    return rk;
+}
+
+/* register numbers have to fit the A field of an instruction. when they run
+ * out the code is rejected, register 0 only stands in until compiling ends */
+static unsigned int allocate_register(ParserState *parser) {
+    if (parser->next_register == MAX_REGISTERS) {
+        if (!parser->error) {
+            report_error("SyntaxError", "Expression too complex");
         }
+        parser->error = 1;
+        return 0;
+    }
+
+    unsigned int reg = parser->next_register++;
+    if (parser->next_register > parser->regcode->registers) {
+        parser->regcode->registers = parser->next_register;
     }
+    return reg;
+}
 
-    *ind = -1;
+static void emit_register(ParserState *parser, instruction_t instruction) {
+    append_to_register_code(parser->regcode, instruction);
 }
 
+/* emitters */
 static void emit_opcode(BytecodeArray *array, opcode_t op) {
     append_to_bytecode_dynarray(array, op);
 }
 
-static void emit_constant(BytecodeArray *array, Value val) {
-    append_to_bytecode_dynarray(array, OP_CONSTANT);
-    append_to_bytecode_dynarray(array, array->constants->elements); // index of constant
-    append_to_value_dynarray(array->constants, val);
+/* records the stack effect of an emitted opcode, its pops and pushes
+ * separately. the handlers in evaluate() don't check the stack, so code which
+ * would pop more than it pushed can't be run */
+static void adjust_depth(ParserState *parser, int effect) {
+    parser->depth += effect;
+    if (parser->depth < 0) {
+        if (!parser->error) {
+            report_error("SyntaxError", "Expected an operand");
+        }
+        parser->error = 1;
+    }
+    if (parser->depth > (int)parser->bytecode->max_stack) {
+        parser->bytecode->max_stack = parser->depth;
+    }
 }
 
-static void emit_set_name(ParserState *parser, char *str) {
-    BytecodeArray *code = parser->bytecode;
-    int ind = -1;
-    index_of(code->names, str, &ind);
-    append_to_bytecode_dynarray(code, OP_SET_GLOBAL);
+static void emit_constant(ParserState *parser, Value val) {
+    unsigned int index = constant_index(parser, val);
 
-    if (ind == -1) {
-        append_to_bytecode_dynarray(code, code->names->elements); // index of constant
-        append_to_name_dynarray(code->names, str);    
-    } else {
-        append_to_bytecode_dynarray(code, ind);
+    if (parser->regcode != NULL) {
+        push_operand(parser, RK_CONSTANT | index);
+        return;
     }
+
+    emit_opcode(parser->bytecode, OP_CONSTANT);
+    emit_opcode(parser->bytecode, index);
+    adjust_depth(parser, 1);
 }
 
-static void emit_get_name(ParserState *parser, char *str) {
-    BytecodeArray *code = parser->bytecode;
-    int ind = -1;
-    index_of(code->names, str, &ind);
-    append_to_bytecode_dynarray(code, OP_GET_GLOBAL);
+static void emit_set_name(ParserState *parser, Token *name) {
+    unsigned int index = name_index(parser, name);
 
-    if (ind == -1) {
-        append_to_bytecode_dynarray(code, code->names->elements); // index of constant
-        append_to_name_dynarray(code->names, str);    
-    } else {
-        append_to_bytecode_dynarray(code, ind);
+    if (parser->regcode != NULL) {
+        emit_register(parser, ENCODE_ABC(ROP_SET_GLOBAL, index, pop_operand(parser), 0));
+        return;
     }
+
+    emit_opcode(parser->bytecode, OP_SET_GLOBAL);
+    emit_opcode(parser->bytecode, index);
+    adjust_depth(parser, -1);
+}
+
+static void emit_get_name(ParserState *parser, Token *name) {
+    unsigned int index = name_index(parser, name);
+
+    if (parser->regcode != NULL) {
+        unsigned int reg = allocate_register(parser);
+        emit_register(parser, ENCODE_ABX(ROP_GET_GLOBAL, reg, index));
+        push_operand(parser, reg);
+        return;
+    }
+
+    emit_opcode(parser->bytecode, OP_GET_GLOBAL);
+    emit_opcode(parser->bytecode, index);
+    adjust_depth(parser, 1);
+}
+
+static void emit_binary(ParserState *parser, opcode_t op) {
+    if (parser->regcode != NULL) {
+        reg_opcode rop;
+        switch (op) {
+        case OP_ADD: rop = ROP_ADD; break;
+        case OP_SUB: rop = ROP_SUB; break;
+        case OP_MULT: rop = ROP_MULT; break;
+        case OP_DIV: rop = ROP_DIV; break;
+        default: rop = ROP_CMP; break;
+        }
+
+        uint16_t b = pop_operand(parser);
+        uint16_t a = pop_operand(parser);
+        unsigned int reg = allocate_register(parser);
+        emit_register(parser, ENCODE_ABC(rop, reg, a, b));
+        push_operand(parser, reg);
+        return;
+    }
+
+    emit_opcode(parser->bytecode, op);
+    adjust_depth(parser, -2);
+    adjust_depth(parser, 1);
+}
+
+static void emit_negate(ParserState *parser) {
+    if (parser->regcode != NULL) {
+        uint16_t a = pop_operand(parser);
+        unsigned int reg = allocate_register(parser);
+        emit_register(parser, ENCODE_ABC(ROP_NEGATE, reg, a, 0));
+        push_operand(parser, reg);
+        return;
+    }
+
+    emit_opcode(parser->bytecode, OP_NEGATE);
+    adjust_depth(parser, -1);
+    adjust_depth(parser, 1);
+}
+
+static void emit_return(ParserState *parser) {
+    if (parser->regcode != NULL) {
+        if (parser->operand_count > 0) {
+            emit_register(parser, ENCODE_ABC(ROP_RETURN, 1, pop_operand(parser), 0));
+        } else {
+            emit_register(parser, ENCODE_ABC(ROP_RETURN, 0, 0, 0));
+        }
+        return;
+    }
+
+    emit_opcode(parser->bytecode, OP_RETURN);
 }
 
 /* parsing functions */
@@ -171,7 +407,10 @@ static void parse_precedence(ParserState *parser, Precedence prec) {
     ParsingFunction prefix = get_rule(parser->current)->prefix;
 
     if (prefix == NULL) {
-        printf("expected expression\n");
+        if (!parser->error) {
+            report_error("SyntaxError", "Expected expression");
+        }
+        parser->error = 1;
         return;
     }
 
@@ -192,16 +431,16 @@ static void binary(ParserState *parser) {
     printf("in binary\n");
     #endif
 
-    Token *operator = parser->current;
+    Token operator = *parser->current;
     advance(parser);
-    parse_precedence(parser, get_rule(operator)->precedence + 1);
-
-    switch (operator->type) {
-        case T_PLUS: emit_opcode(parser->bytecode, OP_ADD); break;
-        case T_MINUS: emit_opcode(parser->bytecode, OP_SUB); break;
-        case T_ASTERISK: emit_opcode(parser->bytecode, OP_MULT); break;
-        case T_SLASH: emit_opcode(parser->bytecode, OP_DIV); break;
-        case T_DBL_EQL: emit_opcode(parser->bytecode, OP_CMP); break;
+    parse_precedence(parser, get_rule(&operator)->precedence + 1);
+
+    switch (operator.type) {
+        case T_PLUS: emit_binary(parser, OP_ADD); break;
+        case T_MINUS: emit_binary(parser, OP_SUB); break;
+        case T_ASTERISK: emit_binary(parser, OP_MULT); break;
+        case T_SLASH: emit_binary(parser, OP_DIV); break;
+        case T_DBL_EQL: emit_binary(parser, OP_CMP); break;
         default:
         break;
     }
@@ -216,12 +455,12 @@ static void unary(ParserState *parser) {
     printf("in unary\n");
     #endif
 
-    Token *operator = parser->current;
+    Token operator = *parser->current;
     advance(parser);
-    parse_precedence(parser, get_rule(operator)->precedence + 1);
+    parse_precedence(parser, get_rule(&operator)->precedence + 1);
 
-    switch (operator->type) {
-        case T_MINUS: emit_opcode(parser->bytecode, OP_SUB); break;
+    switch (operator.type) {
+        case T_MINUS: emit_negate(parser); break;
         default:
         break;
     }
@@ -231,7 +470,7 @@ static void unary(ParserState *parser) {
 }
 
 static void identifier(ParserState *parser) {
-    emit_get_name(parser, parser->current->value);
+    emit_get_name(parser, parser->current);
     advance(parser);
 }
 
@@ -240,7 +479,26 @@ static void number(ParserState *s) {
     printf("in number\n");
     #endif
 
-    emit_constant(s->bytecode, double_value(atof(s->current->value)));
+    /* the token's text is copied out because strtol() and atof() would read
+     * past its end, e.g. the exponent in "1e5". only unusually long literals
+     * need the heap */
+    char buf[64];
+    unsigned int length = s->current->length;
+    char *literal = length < sizeof buf ? buf : malloc(length + 1);
+    memcpy(literal, s->source + s->current->offset, length);
+    literal[length] = '\0';
+
+    if (s->current->type == T_INTEGER) {
+        /* literals too big for a long are kept as doubles */
+        errno = 0;
+        long integer = strtol(literal, NULL, 10);
+        emit_constant(s, errno == ERANGE ? double_value(atof(literal)) : int_value(integer));
+    } else {
+        emit_constant(s, double_value(atof(literal)));
+    }
+    if (literal != buf) {
+        free(literal);
+    }
     advance(s);
 
     #ifdef DEBUG_PARSER
@@ -253,7 +511,9 @@ static void string(ParserState *s) {
     printf("in number\n");
     #endif
 
-    emit_constant(s->bytecode, string_value(s->current->value));
+    Token *literal = s->current;
+    emit_constant(s, string_ref_value(
+                intern_entry(s->symbols, s->source + literal->offset, literal->length)->key));
     advance(s);
 
     #ifdef DEBUG_PARSER
@@ -261,6 +521,12 @@ static void string(ParserState *s) {
     #endif
 }
 
+/* the lexer has already reported what is wrong with the token */
+static void error_token(ParserState *s) {
+    s->error = 1;
+    advance(s);
+}
+
 static void grouping(ParserState *s) {
     advance(s);
     expression(s);
@@ -282,7 +548,7 @@ static void assignment(ParserState *parser) {
         return;
     }
 
-    Token *name = parser->current;
+    Token name = *parser->current;
 
     advance(parser);
     if (!expect(parser, T_EQL)) {
@@ -293,5 +559,5 @@ static void assignment(ParserState *parser) {
     advance(parser);
     expression(parser);
 
-    emit_set_name(parser, name->value);
+    emit_set_name(parser, &name);
 }
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "arith.h"
+#include "register_vm.h"
+
+/* register code array */
+RegisterCode *create_register_code() {
+    RegisterCode *code = malloc(sizeof *code);
+    code->elements = 0;
+    code->capacity = DYNARRAY_INITIAL_SIZE;
+    code->array = malloc(DYNARRAY_INITIAL_SIZE * (sizeof *code->array));
+    code->constants = create_value_dynarray(NULL);
+    code->names = NULL; // handled by vm
+    code->registers = 0;
+    return code;
+}
+
+void append_to_register_code(RegisterCode *code, instruction_t instruction) {
+    if (code->elements == code->capacity) {
+        code->capacity *= DYNARRAY_GROW_BY_FACTOR;
+        code->array = realloc(code->array, code->capacity * (sizeof *code->array));
+
+        if (code->array == NULL) {
+            printf("got NULL while performing array realloc\n");
+            return;
+        }
+    }
+
+    code->array[code->elements++] = instruction;
+}
+
+void free_register_code(RegisterCode *code) {
+    free_value_dynarray(code->constants);
+    free(code->array);
+    code->array = NULL;
+
+    free(code);
+    code = NULL;
+}
+
+/* dispatch */
+#define RK(x) ((x) & RK_CONSTANT ? constants[(x) & 0xff] : registers[(x)])
+
+#ifdef COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTION() vm->stats.instructions++
+#else
+#define COUNT_INSTRUCTION() (void)0
+#endif /* COUNT_INSTRUCTIONS */
+
+#ifdef THREADED_DISPATCH
+#define TARGET(op) target_##op
+#define DISPATCH()                                \
+    do {                                          \
+        COUNT_INSTRUCTION();                      \
+        i = *ip++;                                \
+        goto *dispatch_table[REG_OP(i)];          \
+    } while (0)
+#else
+#define TARGET(op) case op
+#define DISPATCH() break
+#endif /* THREADED_DISPATCH */
+
+#define BINARY(fn, symbol)                                                    \
+    do {                                                                      \
+        if (!fn(RK(REG_B(i)), RK(REG_C(i)), &registers[REG_A(i)])) {          \
+            report_error("TypeError", "Incompatible types for '" symbol "'"); \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+void evaluate_register(VirtualMachine *vm, RegisterCode *code) {
+    instruction_t *ip = code->array;
+    instruction_t i;
+    Value *constants = code->constants->array;
+    Stack *stack = &vm->stack;
+
+    /* one more slot than registers for a constant result pushed by ROP_RETURN */
+    if (!reserve_stack(stack, code->registers + 1)) {
+        report_error("RuntimeError", "stack overflow");
+        return;
+    }
+
+    reserve_globals(vm);
+    Value *globals = vm->globals->array;
+    Value *registers = &stack->at[stack->head];
+
+#ifdef THREADED_DISPATCH
+    static void *dispatch_table[64] = {
+        [0 ... 63]       = &&target_unknown,
+        [ROP_RETURN]     = &&target_ROP_RETURN,
+        [ROP_GET_GLOBAL] = &&target_ROP_GET_GLOBAL,
+        [ROP_SET_GLOBAL] = &&target_ROP_SET_GLOBAL,
+        [ROP_ADD]        = &&target_ROP_ADD,
+        [ROP_SUB]        = &&target_ROP_SUB,
+        [ROP_MULT]       = &&target_ROP_MULT,
+        [ROP_DIV]        = &&target_ROP_DIV,
+        [ROP_CMP]        = &&target_ROP_CMP,
+        [ROP_NEGATE]     = &&target_ROP_NEGATE,
+    };
+
+    DISPATCH();
+#else
+    for (;;) {
+        COUNT_INSTRUCTION();
+        i = *ip++;
+        switch (REG_OP(i)) {
+#endif /* THREADED_DISPATCH */
+        TARGET(ROP_RETURN):
+            if (REG_A(i)) {
+                push(stack, RK(REG_B(i)));
+            }
+            return;
+        TARGET(ROP_GET_GLOBAL): {
+            unsigned int slot = REG_BX(i);
+            Value value = globals[slot];
+            if (IS_UNDEFINED(value) && !get_shared_global(vm, slot, &value)) {
+                report_error("RuntimeError", "variable '%s' not found", vm->names.array[slot]);
+                return;
+            }
+            registers[REG_A(i)] = value;
+            DISPATCH();
+        }
+        TARGET(ROP_SET_GLOBAL):
+            define_global(vm, REG_A(i), RK(REG_B(i)));
+            DISPATCH();
+        TARGET(ROP_ADD):
+            BINARY(arith_add, "+");
+            DISPATCH();
+        TARGET(ROP_SUB):
+            BINARY(arith_sub, "-");
+            DISPATCH();
+        TARGET(ROP_MULT):
+            BINARY(arith_mult, "*");
+            DISPATCH();
+        TARGET(ROP_DIV):
+            BINARY(arith_div, "/");
+            DISPATCH();
+        TARGET(ROP_CMP):
+            BINARY(arith_cmp, "==");
+            DISPATCH();
+        TARGET(ROP_NEGATE):
+            if (!arith_negate(RK(REG_B(i)), &registers[REG_A(i)])) {
+                report_error("TypeError", "Incompatible type for unary '-'");
+                return;
+            }
+            DISPATCH();
+#ifdef THREADED_DISPATCH
+        target_unknown:
+#else
+        default:
+#endif /* THREADED_DISPATCH */
+            report_error("RuntimeError", "unknown instruction %08x", i);
+            return;
+#ifndef THREADED_DISPATCH
+        }
+    }
+#endif /* THREADED_DISPATCH */
+}
+
+#undef RK
+#undef COUNT_INSTRUCTION
+#undef TARGET
+#undef DISPATCH
+#undef BINARY
+
+unsigned int execute_register(VirtualMachine *vm, RegisterCode *code) {
+    if (vm == NULL || code == NULL || code->array == NULL) {
+        return 0;
+    }
+
+    evaluate_register(vm, code);
+
+    if (vm->stack.head != 0) {
+        Value v = pop(&vm->stack);
+        print_value(&v);
+        printf("\n");
+    }
+    shrink_stack(&vm->stack);
+    return 1;
+}
+
+#ifdef DEBUG_COMPILER
+static void print_rk(RegisterCode *code, unsigned int rk) {
+    if (rk & RK_CONSTANT) {
+        printf("K(");
+        print_value(&code->constants->array[rk & 0xff]);
+        printf(")");
+    } else {
+        printf("r%u", rk);
+    }
+}
+
+void print_register_disassembly(RegisterCode *code) {
+    static const char *names[] = {
+        [ROP_RETURN] = "RETURN", [ROP_GET_GLOBAL] = "GET_GLOBAL",
+        [ROP_SET_GLOBAL] = "SET_GLOBAL",
+        [ROP_ADD] = "ADD", [ROP_SUB] = "SUB", [ROP_MULT] = "MULT",
+        [ROP_DIV] = "DIV", [ROP_CMP] = "CMP", [ROP_NEGATE] = "NEGATE",
+    };
+
+    fputs("---- register disassembly ----\n", stdout);
+    printf("registers: %u\n", code->registers);
+    for (unsigned int n = 0; n < code->elements; n++) {
+        instruction_t i = code->array[n];
+        printf("%04d  %-10s ", n, names[REG_OP(i)]);
+        switch (REG_OP(i)) {
+        case ROP_RETURN:
+            if (REG_A(i)) {
+                print_rk(code, REG_B(i));
+            }
+            break;
+        case ROP_GET_GLOBAL:
+            printf("r%u, %s", REG_A(i), code->names->array[REG_BX(i)]);
+            break;
+        case ROP_SET_GLOBAL:
+            printf("%s, ", code->names->array[REG_A(i)]);
+            print_rk(code, REG_B(i));
+            break;
+        case ROP_NEGATE:
+            printf("r%u, ", REG_A(i));
+            print_rk(code, REG_B(i));
+            break;
+        default:
+            printf("r%u, ", REG_A(i));
+            print_rk(code, REG_B(i));
+            printf(", ");
+            print_rk(code, REG_C(i));
+        }
+        printf("\n");
+    }
+}
+#endif /* DEBUG_COMPILER */
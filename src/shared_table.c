@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "shared_table.h"
+
+/* home slots come from the low bits of the hash and stripes from the high
+ * bits, so neighbouring slots don't all share a stripe */
+#define STRIPE(hash) ((hash) >> 28 & (SHARED_TABLE_STRIPES - 1))
+
+static SharedSnapshot *allocate_snapshot(unsigned int capacity) {
+    SharedSnapshot *snapshot = malloc(sizeof *snapshot + capacity * sizeof(SharedSlot));
+    memset(snapshot->slots, 0, capacity * sizeof(SharedSlot));
+    snapshot->capacity = capacity;
+    snapshot->retired = NULL;
+    return snapshot;
+}
+
+/* the value words are read and written one atomic word at a time, the
+ * stripe's sequence count tells a reader whether they belong together */
+static inline void load_value(const SharedSlot *slot, Value *value) {
+    uint64_t words[SHARED_VALUE_WORDS];
+    for (unsigned int i = 0; i < SHARED_VALUE_WORDS; i++) {
+        words[i] = __atomic_load_n(&slot->value[i], __ATOMIC_RELAXED);
+    }
+    memcpy(value, words, sizeof *value);
+}
+
+static inline void store_value(SharedSlot *slot, Value value) {
+    uint64_t words[SHARED_VALUE_WORDS] = { 0 };
+    memcpy(words, &value, sizeof value);
+    for (unsigned int i = 0; i < SHARED_VALUE_WORDS; i++) {
+        __atomic_store_n(&slot->value[i], words[i], __ATOMIC_RELAXED);
+    }
+}
+
+/* returns key's slot, or the empty slot where it would go, and sets found to
+ * say which. the table never fills, so there always is one. found has to come
+ * from the probe itself: by the time the caller looked at an empty slot again
+ * a writer could have filled it with another key */
+static SharedSlot *probe(SharedSnapshot *snapshot, const char *key, uint32_t hash,
+        unsigned int length, int *found) {
+    unsigned int mask = snapshot->capacity - 1;
+
+    for (unsigned int index = hash & mask;; index = (index + 1) & mask) {
+        SharedSlot *slot = &snapshot->slots[index];
+        const char *resident = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+
+        if (resident == NULL) {
+            *found = 0;
+            return slot;
+        }
+        if (slot->hash == hash && slot->length == length && memcmp(resident, key, length) == 0) {
+            *found = 1;
+            return slot;
+        }
+    }
+}
+
+/* caller holds the stripe's lock */
+static void write_value(SharedStripe *stripe, SharedSlot *slot, Value value) {
+    __atomic_store_n(&stripe->sequence, stripe->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    store_value(slot, value);
+    __atomic_store_n(&stripe->sequence, stripe->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/* fills an empty slot, publishing the key last. caller holds insert_lock */
+static void fill_slot(SharedSlot *slot, const char *key, uint32_t hash, unsigned int length,
+        const uint64_t *value) {
+    slot->hash = hash;
+    slot->length = length;
+    for (unsigned int i = 0; i < SHARED_VALUE_WORDS; i++) {
+        __atomic_store_n(&slot->value[i], value[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+}
+
+/* caller holds insert_lock */
+static void grow_table(SharedTable *table) {
+    for (unsigned int i = 0; i < SHARED_TABLE_STRIPES; i++) {
+        pthread_mutex_lock(&table->stripes[i].lock);
+    }
+
+    SharedSnapshot *old = table->current;
+    SharedSnapshot *snapshot = allocate_snapshot(old->capacity * 2);
+
+    for (unsigned int i = 0; i < old->capacity; i++) {
+        SharedSlot *slot = &old->slots[i];
+        int found;
+        if (slot->key != NULL) {
+            fill_slot(probe(snapshot, slot->key, slot->hash, slot->length, &found), slot->key,
+                    slot->hash, slot->length, slot->value);
+        }
+    }
+
+    snapshot->retired = old;
+    __atomic_store_n(&table->current, snapshot, __ATOMIC_RELEASE);
+
+    for (unsigned int i = 0; i < SHARED_TABLE_STRIPES; i++) {
+        pthread_mutex_unlock(&table->stripes[i].lock);
+    }
+}
+
+/* public functions */
+SharedTable *init_shared_table() {
+    SharedTable *table = malloc(sizeof *table);
+    table->current = allocate_snapshot(SHARED_TABLE_DEFAULT_SIZE);
+    table->elements = 0;
+    pthread_mutex_init(&table->insert_lock, NULL);
+    for (unsigned int i = 0; i < SHARED_TABLE_STRIPES; i++) {
+        pthread_mutex_init(&table->stripes[i].lock, NULL);
+        table->stripes[i].sequence = 0;
+    }
+    return table;
+}
+
+void free_shared_table(SharedTable *table) {
+    SharedSnapshot *snapshot = table->current;
+    for (unsigned int i = 0; i < snapshot->capacity; i++) {
+        free((char *)snapshot->slots[i].key);
+    }
+
+    while (snapshot != NULL) {
+        SharedSnapshot *retired = snapshot->retired;
+        free(snapshot);
+        snapshot = retired;
+    }
+
+    pthread_mutex_destroy(&table->insert_lock);
+    for (unsigned int i = 0; i < SHARED_TABLE_STRIPES; i++) {
+        pthread_mutex_destroy(&table->stripes[i].lock);
+    }
+    free(table);
+}
+
+void shared_table_set(SharedTable *table, const char *key, Value value) {
+    unsigned int length = strlen(key);
+    uint32_t hash = hash_bytes(key, length);
+    SharedStripe *stripe = &table->stripes[STRIPE(hash)];
+
+    /* the common case, replacing a value, only takes the stripe's lock. the
+     * snapshot can't be replaced while it is held */
+    int found;
+    pthread_mutex_lock(&stripe->lock);
+    SharedSlot *slot = probe(table->current, key, hash, length, &found);
+    if (found) {
+        write_value(stripe, slot, value);
+        pthread_mutex_unlock(&stripe->lock);
+        return;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    pthread_mutex_lock(&table->insert_lock);
+    if ((table->elements + 1) * 100 / table->current->capacity > 70) {
+        grow_table(table);
+    }
+
+    /* another writer may have added key since the stripe was unlocked */
+    pthread_mutex_lock(&stripe->lock);
+    slot = probe(table->current, key, hash, length, &found);
+    if (found) {
+        write_value(stripe, slot, value);
+    } else {
+        uint64_t words[SHARED_VALUE_WORDS] = { 0 };
+        memcpy(words, &value, sizeof value);
+
+        char *copy = malloc(length + 1);
+        memcpy(copy, key, length + 1);
+        fill_slot(slot, copy, hash, length, words);
+        table->elements++;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    pthread_mutex_unlock(&table->insert_lock);
+}
+
+int shared_table_get(SharedTable *table, const char *key, Value *value) {
+    unsigned int length = strlen(key);
+    return shared_table_get_hashed(table, key, hash_bytes(key, length), length, value);
+}
+
+int shared_table_get_hashed(SharedTable *table, const char *key, uint32_t hash, uint32_t length,
+        Value *value) {
+    SharedStripe *stripe = &table->stripes[STRIPE(hash)];
+
+    for (;;) {
+        unsigned int sequence = __atomic_load_n(&stripe->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue;
+        }
+
+        SharedSnapshot *snapshot = __atomic_load_n(&table->current, __ATOMIC_ACQUIRE);
+        int found;
+        SharedSlot *slot = probe(snapshot, key, hash, length, &found);
+        if (found) {
+            load_value(slot, value);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&stripe->sequence, __ATOMIC_RELAXED) == sequence) {
+            return found;
+        }
+    }
+}
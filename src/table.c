@@ -1,139 +1,419 @@
+#include "hash.h"
 #include "table.h"
 
-/* value functions */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 
-#define FNV1_32_INIT 2166136261u
-#define FNV1_32_PRIME 16777619u
+/* the hash is split into H1, which picks the entry's home slot, and H2, the 7
+ * bit fragment stored in the control byte */
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((int8_t)((hash) & 0x7f))
 
-static uint32_t hash_string(const char *string) {
-    static const uint32_t prime = FNV1_32_PRIME;
-    uint32_t hash = FNV1_32_INIT;
-    unsigned int len = strlen(string);
+/* group matching: returns a bitmask with bit i set if slot i of the group
+ * starting at ctrl holds byte */
+#ifdef __SSE2__
+static inline uint32_t match_byte(const int8_t *ctrl, int8_t byte) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), group));
+}
+#else
+static inline uint32_t match_byte(const int8_t *ctrl, int8_t byte) {
+    uint32_t mask = 0;
+    for (unsigned int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(ctrl[i] == byte) << i;
+    }
+    return mask;
+}
+#endif /* __SSE2__ */
+
+static inline unsigned int home_slot(HashTable *table, uint32_t hash) {
+    return H1(hash) & (table->capacity - 1);
+}
+
+/* number of entries a table with capacity slots holds before it must grow */
+static inline unsigned int usable_entries(unsigned int capacity) {
+    return capacity * 7 / 10;
+}
 
-    for (unsigned int i = 0; i < len; i++) {
-        hash ^= string[i];
-        hash *= prime;
+/* the index array uses the narrowest integer which can number every entry */
+static inline size_t index_width(unsigned int capacity) {
+    if (capacity <= 1u << 8) {
+        return sizeof(uint8_t);
+    } else if (capacity <= 1u << 16) {
+        return sizeof(uint16_t);
     }
+    return sizeof(uint32_t);
+}
 
-    return hash;
+/* number of the entry the full slot index refers to */
+static inline unsigned int get_index(HashTable *table, unsigned int slot) {
+    switch (index_width(table->capacity)) {
+    case sizeof(uint8_t):
+        return ((uint8_t *)table->indices)[slot];
+    case sizeof(uint16_t):
+        return ((uint16_t *)table->indices)[slot];
+    default:
+        return ((uint32_t *)table->indices)[slot];
+    }
 }
 
-static void resize_table(HashTable *table, unsigned int new_size) {
-    if (table->elements > new_size) {
-        printf("bad\n");
+static inline void set_index(HashTable *table, unsigned int slot, unsigned int index) {
+    switch (index_width(table->capacity)) {
+    case sizeof(uint8_t):
+        ((uint8_t *)table->indices)[slot] = index;
+        break;
+    case sizeof(uint16_t):
+        ((uint16_t *)table->indices)[slot] = index;
+        break;
+    default:
+        ((uint32_t *)table->indices)[slot] = index;
+        break;
     }
+}
 
-    Entry *old_entries = table->entries;
-    table->entries = calloc(new_size, sizeof *table->entries);
+static inline Entry *slot_entry(HashTable *table, unsigned int slot) {
+    return &table->entries[get_index(table, slot)];
+}
+
+/* distance of the entry in slot from its home slot */
+static inline unsigned int probe_length(HashTable *table, unsigned int slot) {
+    return (slot - home_slot(table, slot_entry(table, slot)->hash)) & (table->capacity - 1);
+}
+
+/* sets a control byte along with its copies past the last slot */
+static inline void set_ctrl(HashTable *table, unsigned int slot, int8_t ctrl) {
+    table->ctrl[slot] = ctrl;
+    for (unsigned int i = slot + table->capacity; i < table->capacity + TABLE_GROUP_WIDTH - 1;
+            i += table->capacity) {
+        table->ctrl[i] = ctrl;
+    }
+}
 
-    unsigned int old_capacity = table->capacity;
-    table->capacity = new_size;
+static void allocate_slots(HashTable *table, unsigned int capacity) {
+    table->ctrl = malloc(capacity + TABLE_GROUP_WIDTH - 1);
+    memset(table->ctrl, CTRL_EMPTY, capacity + TABLE_GROUP_WIDTH - 1);
+    table->indices = malloc(capacity * index_width(capacity));
+    table->entries = malloc(usable_entries(capacity) * sizeof *table->entries);
+    table->capacity = capacity;
     table->elements = 0;
+    table->used = 0;
+    table->max_probe = 0;
+}
+
+static inline int key_equals(Entry *entry, const char *key, uint32_t hash, unsigned int length) {
+    return entry->hash == hash && entry->length == length
+        && (entry->key == key || memcmp(entry->key, key, length) == 0);
+}
+
+/* Entries are never separated from their home slot by an empty slot, so the
+ * scan stops at the first empty slot, or once it has passed the longest probe
+ * in the table. Returns the slot which refers to key's entry, or -1. */
+static long find_slot(HashTable *table, const char *key, uint32_t hash, unsigned int length) {
+    unsigned int mask = table->capacity - 1;
+    unsigned int slot = home_slot(table, hash);
+    int8_t h2 = H2(hash);
+
+    for (unsigned int probed = 0; probed <= table->max_probe; probed += TABLE_GROUP_WIDTH) {
+        const int8_t *ctrl = table->ctrl + slot;
+        uint32_t match = match_byte(ctrl, h2);
+        uint32_t empty = match_byte(ctrl, CTRL_EMPTY);
+
+        if (empty != 0) {
+            match &= (empty & -empty) - 1;
+        }
+
+        for (; match != 0; match &= match - 1) {
+            unsigned int candidate = (slot + __builtin_ctz(match)) & mask;
+            if (key_equals(slot_entry(table, candidate), key, hash, length)) {
+                return candidate;
+            }
+        }
 
-    for (unsigned int i = 0; i < old_capacity; i++) {
-        if (old_entries[i].occupied && !old_entries[i].deleted) {
-            add_entry(table, old_entries[i].key, old_entries[i].value);
+        if (empty != 0) {
+            return -1;
         }
+        slot = (slot + TABLE_GROUP_WIDTH) & mask;
     }
 
-    free(old_entries);
-    old_entries = NULL;
+    return -1;
 }
 
-/* public functions */
-HashTable *init_table() {
-    HashTable *table = malloc(sizeof *table);
+/* places a reference to entry number index, which has already probed distance
+ * slots to reach slot, displacing residents closer to home. Only the index
+ * array moves; the entry itself stays where it is. */
+static void place_index(HashTable *table, unsigned int index, unsigned int slot,
+        unsigned int distance) {
+    unsigned int mask = table->capacity - 1;
+    int8_t h2 = H2(table->entries[index].hash);
 
-    table->entries = calloc(TABLE_DEFAULT_SIZE, sizeof *table->entries);
-    table->elements = 0;
-    table->capacity = TABLE_DEFAULT_SIZE;
+    while (CTRL_IS_FULL(table->ctrl[slot])) {
+        unsigned int resident = probe_length(table, slot);
 
-    return table;
-}
+        /* robin hood: the entry further from home keeps the slot */
+        if (resident < distance) {
+            unsigned int displaced = get_index(table, slot);
+            int8_t displaced_h2 = table->ctrl[slot];
+            set_index(table, slot, index);
+            set_ctrl(table, slot, h2);
+            if (distance > table->max_probe) {
+                table->max_probe = distance;
+            }
 
-void add_entry(HashTable *table, char *key, Value value) {
-    if ((table->elements + 1) * 100 / table->capacity > 70) {
-        resize_table(table, table->capacity * 2);
+            index = displaced;
+            h2 = displaced_h2;
+            distance = resident;
+        }
+
+        slot = (slot + 1) & mask;
+        distance++;
     }
-    const uint32_t hash = hash_string(key);
-    unsigned int index = hash & (table->capacity - 1);
 
-    while (table->entries[index].occupied && !table->entries[index].deleted) {
-        index = (index + 1) & (table->capacity - 1);
+    set_index(table, slot, index);
+    set_ctrl(table, slot, h2);
+    if (distance > table->max_probe) {
+        table->max_probe = distance;
     }
+}
 
-    table->entries[index] = (Entry) { key, value, 1, 0 };
+/* appends entry to the entries array, which must have room for it, and
+ * returns its number. the caller places its index. */
+static inline unsigned int append_entry(HashTable *table, Entry entry) {
+    table->entries[table->used] = entry;
     table->elements++;
+    return table->used++;
 }
 
-Entry *get_entry(HashTable *table, char *key) {
-    const uint32_t hash = hash_string(key);
-    unsigned int index = hash & (table->capacity - 1);
-    unsigned int moveEntry = 0;
-    unsigned int moveIndex = 0;
-
-    while (table->entries[index].key != key) {
-        if (!table->entries[index].occupied) {
-            return NULL;
-        }
+/* rebuilds the table with new_size slots, dropping the holes deleted entries
+ * left in the entries array while keeping the live ones in order */
+static void resize_table(HashTable *table, unsigned int new_size) {
+    int8_t *old_ctrl = table->ctrl;
+    void *old_indices = table->indices;
+    Entry *old_entries = table->entries;
+    unsigned int old_used = table->used;
+
+    allocate_slots(table, new_size);
 
-        if (!moveEntry && table->entries[index].deleted) {
-            moveEntry = 1;
-            moveIndex = index;
+    for (unsigned int i = 0; i < old_used; i++) {
+        if (old_entries[i].key != NULL) {
+            unsigned int index = append_entry(table, old_entries[i]);
+            place_index(table, index, home_slot(table, old_entries[i].hash), 0);
         }
+    }
+
+    free(old_ctrl);
+    free(old_indices);
+    free(old_entries);
+}
 
-        index = (index + 1) & (table->capacity - 1);
+/* makes room in the entries array for one more entry. A table whose entries
+ * array is full of holes is compacted in place rather than grown; at least a
+ * quarter of its usable entries are then free, so compaction stays amortized
+ * constant time. */
+static inline void reserve_entry(HashTable *table) {
+    if (table->used < usable_entries(table->capacity)) {
+        return;
     }
 
-    if (table->entries[index].deleted) {
-        return NULL;
+    if (table->elements * 4 >= usable_entries(table->capacity) * 3) {
+        resize_table(table, table->capacity * 2);
+    } else {
+        resize_table(table, table->capacity);
     }
+}
 
-    if (moveEntry) { /* perform lazy move */
-        table->entries[moveIndex] = table->entries[index];
-        table->entries[index].deleted = 1;
-        return &table->entries[moveIndex];
-    } else { 
-        return &table->entries[index];
+/* Finds key's entry or appends it with a nil value in the same pass: under
+ * Robin Hood ordering a key can't lie past a resident closer to its home than
+ * the probe is, so that is where a missing key belongs. Only a table about to
+ * be rebuilt is searched first, to avoid rebuilding it for a key it already
+ * has. Returns the entry's number. */
+static unsigned int upsert_index(HashTable *table, char *key, uint32_t hash, unsigned int length,
+        int *inserted) {
+    if (table->used == usable_entries(table->capacity)) {
+        long found = find_slot(table, key, hash, length);
+        if (found >= 0) {
+            *inserted = 0;
+            return get_index(table, found);
+        }
+        reserve_entry(table);
     }
+
+    unsigned int mask = table->capacity - 1;
+    unsigned int slot = home_slot(table, hash);
+    unsigned int distance = 0;
+    int8_t h2 = H2(hash);
+
+    while (CTRL_IS_FULL(table->ctrl[slot]) && probe_length(table, slot) >= distance) {
+        if (table->ctrl[slot] == h2 && key_equals(slot_entry(table, slot), key, hash, length)) {
+            *inserted = 0;
+            return get_index(table, slot);
+        }
+        slot = (slot + 1) & mask;
+        distance++;
+    }
+
+    *inserted = 1;
+    unsigned int index = append_entry(table, (Entry) { key, hash, length, nil_value() });
+    place_index(table, index, slot, distance);
+    return index;
+}
+
+/* public functions */
+HashTable *init_table() {
+    HashTable *table = malloc(sizeof *table);
+    allocate_slots(table, TABLE_DEFAULT_SIZE);
+    return table;
+}
+
+void add_entry(HashTable *table, char *key, Value value) {
+    reserve_entry(table);
+
+    unsigned int length = strlen(key);
+    unsigned int index = append_entry(table, (Entry) { key, hash_bytes(key, length), length, value });
+    place_index(table, index, home_slot(table, table->entries[index].hash), 0);
+}
+
+Entry *get_entry(HashTable *table, char *key) {
+    unsigned int length = strlen(key);
+    long slot = find_slot(table, key, hash_bytes(key, length), length);
+    return slot < 0 ? NULL : slot_entry(table, slot);
 }
 
 void update_entry(HashTable *table, char *key, Value value) {
     Entry *e = get_entry(table, key);
     if (e != NULL) {
-        if (e->deleted) {
-            add_entry(table, key, value);
-        } else {
-            e->value = value;
-        }
+        e->value = value;
     }
 }
 
+Entry *upsert_entry(HashTable *table, char *key, Value value) {
+    unsigned int length = strlen(key);
+    int inserted;
+    unsigned int index = upsert_index(table, key, hash_bytes(key, length), length, &inserted);
+    Entry *e = &table->entries[index];
+    e->value = value;
+    return e;
+}
+
 void del_entry(HashTable *table, char *key) {
+    unsigned int length = strlen(key);
+    long found = find_slot(table, key, hash_bytes(key, length), length);
+    if (found < 0) {
+        return;
+    }
+
+    /* the entry leaves a hole, unless it was the last one appended */
+    unsigned int index = get_index(table, found);
+    table->entries[index].key = NULL;
+    if (index == table->used - 1) {
+        table->used--;
+    }
+
+    /* backward shift: pull every following slot whose entry isn't in its home
+     * slot back by one, up to the next empty slot or entry at home */
+    unsigned int mask = table->capacity - 1;
+    unsigned int slot = found;
+    unsigned int next = (slot + 1) & mask;
+
+    while (CTRL_IS_FULL(table->ctrl[next]) && probe_length(table, next) != 0) {
+        set_index(table, slot, get_index(table, next));
+        set_ctrl(table, slot, table->ctrl[next]);
+        slot = next;
+        next = (next + 1) & mask;
+    }
+    set_ctrl(table, slot, CTRL_EMPTY);
+    table->elements--;
+
     if (table->capacity > TABLE_DEFAULT_SIZE && table->elements * 100 / table->capacity < 15) {
         resize_table(table, table->capacity / 2);
     }
+}
 
-    Entry *e = get_entry(table, key);
-    if (e != NULL) {
-        e->deleted = 1;
+Entry *intern_entry(HashTable *table, const char *chars, unsigned int length) {
+    int inserted;
+    unsigned int index = upsert_index(table, (char *)chars, hash_bytes(chars, length), length,
+            &inserted);
+    Entry *e = &table->entries[index];
+
+    /* the entry was appended with the caller's pointer, swap in the table's
+     * own copy */
+    if (inserted) {
+        e->key = malloc(length + 1);
+        memcpy(e->key, chars, length);
+        e->key[length] = '\0';
     }
+    return e;
+}
 
-    table->elements--;
+Entry *table_next_entry(HashTable *table, unsigned int *position) {
+    while (*position < table->used) {
+        Entry *e = &table->entries[(*position)++];
+        if (e->key != NULL) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void free_table_keys(HashTable *table) {
+    unsigned int position = 0;
+    for (Entry *e; (e = table_next_entry(table, &position)) != NULL;) {
+        free(e->key);
+    }
+}
+
+size_t table_memory_usage(HashTable *table) {
+    return sizeof *table
+        + table->capacity + TABLE_GROUP_WIDTH - 1
+        + table->capacity * index_width(table->capacity)
+        + usable_entries(table->capacity) * sizeof *table->entries;
+}
+
+void table_stats(HashTable *table, TableStats *stats) {
+    stats->capacity = table->capacity;
+    stats->elements = table->elements;
+    stats->holes = table->used - table->elements;
+    stats->max_probe = table->max_probe;
+    stats->memory = table_memory_usage(table);
+}
+
+void table_compact(HashTable *table) {
+    unsigned int capacity = TABLE_DEFAULT_SIZE;
+    while (usable_entries(capacity) < table->elements) {
+        capacity *= 2;
+    }
+
+    if (capacity != table->capacity || table->used != table->elements) {
+        resize_table(table, capacity);
+    }
+}
+
+void table_probe_histogram(HashTable *table, unsigned int *histogram, unsigned int buckets) {
+    memset(histogram, 0, buckets * sizeof *histogram);
+
+    for (unsigned int i = 0; i < table->capacity; i++) {
+        if (CTRL_IS_FULL(table->ctrl[i])) {
+            unsigned int length = probe_length(table, i);
+            histogram[length < buckets ? length : buckets - 1]++;
+        }
+    }
 }
 
 void free_table(HashTable *table) {
 #ifdef HEAP_ALLOCD
-    for (unsigned int i = 0; i < table->capacity; i++) {
-        if (table->entries[i].occupied) {
-            // free(table->entries[i].key);
-            if (table->entries[i].value.type == VAL_TYPE_STRING) {
-                free(table->entries[i].value.as.string);
-            }
+    unsigned int position = 0;
+    for (Entry *e; (e = table_next_entry(table, &position)) != NULL;) {
+        // free(e->key);
+        if (IS_STRING(e->value)) {
+            free(AS_STRING(e->value));
         }
     }
 #endif /* HEAP_ALLOCD */
 
+    free(table->ctrl);
+    table->ctrl = NULL;
+    free(table->indices);
+    table->indices = NULL;
     free(table->entries);
     table->entries = NULL;
 
@@ -143,9 +423,10 @@ void free_table(HashTable *table) {
 
 #ifdef DEBUG_TABLE
 void print_table(HashTable *table) {
-    for (unsigned int i = 0; i < table->capacity; i++) {
-        printf("%s:  ", table->entries[i].key);
-        print_value(&table->entries[i].value);
+    unsigned int position = 0;
+    for (Entry *e; (e = table_next_entry(table, &position)) != NULL;) {
+        printf("%s:  ", e->key);
+        print_value(&e->value);
         printf("\n");
     }
 }
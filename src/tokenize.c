@@ -3,14 +3,18 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "error.h"
 #include "tokenize.h"
 
+#ifdef SIMD_SCAN
+#ifdef __AVX2__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif /* __AVX2__ */
+#endif /* SIMD_SCAN */
 
 /* util */
-static int is_alpha(char c) {
-    return ((c >= 97 && c <= 122) || (c >= 65 && c <= 90));
-}
-
 static int is_num(char c) {
     return (c >= 48 && c <= 57);
 }
@@ -23,147 +27,242 @@ static int is_whitespace(char c) {
     return (c == ' ' || c == '\t' || c == '\n');
 }
 
-static int is_quote(char c) {
-    return c == 39 || c == 34;
+static int is_identifier_char(char c) {
+    return is_alpha_num(c) || c == '_';
 }
 
-static int is_symbol(char c) {
-    if (is_quote(c)) {
-        return 0;
-    }
-    return (c >= 33 && c <= 47) || (c >=58 && c <= 64) || (c >= 91 && c <= 96) || (c >=123 && c <=126);
+static int is_number_char(char c) {
+    return is_num(c) || c == '.';
 }
 
-static unsigned int compare_upto(unsigned int upto, const char *string, const char *match) {
-    for (int i = 0; i < upto; i++) {
-        if (string[i] == '\0' || string[i] != match[i]) {
-            return 0;
-        }
-    }
+/* what a token starting with each character is, so tokenize() dispatches with
+ * one lookup. the quotes come after the symbol ranges they fall in so that
+ * they override them */
+typedef enum {
+    START_NONE,
+    START_WHITESPACE,
+    START_IDENTIFIER,
+    START_NUMBER,
+    START_STRING,
+    START_SYMBOL,
+} TokenStart;
+
+static const uint8_t token_starts[256] = {
+    [' '] = START_WHITESPACE, ['\t'] = START_WHITESPACE, ['\n'] = START_WHITESPACE,
+    ['a' ... 'z'] = START_IDENTIFIER, ['A' ... 'Z'] = START_IDENTIFIER,
+    ['0' ... '9'] = START_NUMBER,
+    ['!' ... '/'] = START_SYMBOL, [':' ... '@'] = START_SYMBOL,
+    ['[' ... '`'] = START_SYMBOL, ['{' ... '~'] = START_SYMBOL,
+    ['\''] = START_STRING, ['"'] = START_STRING,
+};
+
+/* keywords
+ *
+ * every keyword hashes to its own slot by its first and last characters and
+ * its length, so a word can only be the keyword in its slot and one compare
+ * settles it. the slots are computed by the compiler from the table below; a
+ * new keyword which collides with another needs a new hash, which the keyword
+ * test would catch */
+#define KEYWORD_SLOTS 32
+#define KEYWORD_SLOT(first, last, length) (((first) + (last) + 2 * (length)) & (KEYWORD_SLOTS - 1))
+#define KEYWORD(text, first, last, type) \
+    [KEYWORD_SLOT(first, last, sizeof text - 1)] = { text, sizeof text - 1, type }
+
+typedef struct {
+    const char *text;
+    unsigned int length;
+    TokenType type;
+} Keyword;
+
+static const Keyword keywords[KEYWORD_SLOTS] = {
+    KEYWORD("and", 'a', 'd', T_AND),
+    KEYWORD("or", 'o', 'r', T_OR),
+    KEYWORD("fun", 'f', 'n', T_FUN),
+    KEYWORD("if", 'i', 'f', T_IF),
+    KEYWORD("else", 'e', 'e', T_ELSE),
+    KEYWORD("for", 'f', 'r', T_FOR),
+    KEYWORD("while", 'w', 'e', T_WHILE),
+    KEYWORD("var", 'v', 'r', T_VAR),
+    KEYWORD("true", 't', 'e', T_TRUE),
+    KEYWORD("false", 'f', 'e', T_FALSE),
+    KEYWORD("nil", 'n', 'l', T_NIL),
+};
+
+
+/* character class scanning
+ *
+ * each class has a mask function which returns a bitmask with bit i set if
+ * character i of the vector starting at p is in the class. bytes outside ascii
+ * compare as negative, so they fall outside every range */
+#ifdef SIMD_SCAN
+#ifdef __AVX2__
+#define SCAN_WIDTH 32
+typedef __m256i ScanVector;
+static inline ScanVector scan_load(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline ScanVector scan_splat(char c) { return _mm256_set1_epi8(c); }
+static inline ScanVector scan_eq(ScanVector a, ScanVector b) { return _mm256_cmpeq_epi8(a, b); }
+static inline ScanVector scan_gt(ScanVector a, ScanVector b) { return _mm256_cmpgt_epi8(a, b); }
+static inline ScanVector scan_or(ScanVector a, ScanVector b) { return _mm256_or_si256(a, b); }
+static inline ScanVector scan_and(ScanVector a, ScanVector b) { return _mm256_and_si256(a, b); }
+static inline uint32_t scan_mask(ScanVector v) { return _mm256_movemask_epi8(v); }
+#else
+#define SCAN_WIDTH 16
+typedef __m128i ScanVector;
+static inline ScanVector scan_load(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline ScanVector scan_splat(char c) { return _mm_set1_epi8(c); }
+static inline ScanVector scan_eq(ScanVector a, ScanVector b) { return _mm_cmpeq_epi8(a, b); }
+static inline ScanVector scan_gt(ScanVector a, ScanVector b) { return _mm_cmpgt_epi8(a, b); }
+static inline ScanVector scan_or(ScanVector a, ScanVector b) { return _mm_or_si128(a, b); }
+static inline ScanVector scan_and(ScanVector a, ScanVector b) { return _mm_and_si128(a, b); }
+static inline uint32_t scan_mask(ScanVector v) { return _mm_movemask_epi8(v); }
+#endif /* __AVX2__ */
+
+#define SCAN_ALL ((uint32_t)((1ull << SCAN_WIDTH) - 1))
+
+/* low <= c && c <= high for each character */
+static inline ScanVector in_range(ScanVector c, char low, char high) {
+    return scan_and(scan_gt(c, scan_splat(low - 1)), scan_gt(scan_splat(high + 1), c));
+}
 
-    return strcmp(string, match) == 0;
+static inline uint32_t whitespace_mask(const char *p) {
+    ScanVector c = scan_load(p);
+    return scan_mask(scan_or(scan_or(scan_eq(c, scan_splat(' ')), scan_eq(c, scan_splat('\t'))),
+            scan_eq(c, scan_splat('\n'))));
 }
 
+/* setting 0x20 lowercases letters without moving digits or '_' into a..z */
+static inline uint32_t identifier_mask(const char *p) {
+    ScanVector c = scan_load(p);
+    ScanVector letters = in_range(scan_or(c, scan_splat(0x20)), 'a', 'z');
+    return scan_mask(scan_or(scan_or(letters, in_range(c, '0', '9')), scan_eq(c, scan_splat('_'))));
+}
 
-/* token matching functions */
-static unsigned int match_keyword(char *word) {
-    if (word == NULL) {
-        return 0;
+static inline uint32_t number_mask(const char *p) {
+    ScanVector c = scan_load(p);
+    return scan_mask(scan_or(in_range(c, '0', '9'), scan_eq(c, scan_splat('.'))));
+}
+
+static inline uint32_t byte_mask(const char *p, char byte) {
+    return scan_mask(scan_eq(scan_load(p), scan_splat(byte)));
+}
+
+/* advances pos a vector at a time while the class mask, an expression of pos,
+ * is all ones, and returns the position of the first character outside the
+ * class once it isn't. vectors are only loaded while they lie in the source,
+ * the caller finishes the last few characters one at a time */
+#define SCAN_VECTORS(pos, size, class_mask)                           \
+    for (; (pos) + SCAN_WIDTH <= (size); (pos) += SCAN_WIDTH) {       \
+        uint32_t outside = ~(class_mask) & SCAN_ALL;                  \
+        if (outside != 0) {                                           \
+            return (pos) + __builtin_ctz(outside);                    \
+        }                                                             \
     }
+#else
+#define SCAN_VECTORS(pos, size, class_mask)
+#endif /* SIMD_SCAN */
+
+/* each returns the position of the first character at or after pos which
+ * isn't part of the run, or size */
+static inline unsigned int skip_whitespace(const char *source, unsigned int size, unsigned int pos) {
+    SCAN_VECTORS(pos, size, whitespace_mask(source + pos));
+    while (pos < size && is_whitespace(source[pos])) {
+        pos++;
+    }
+    return pos;
+}
 
-    switch (word[0]) {
-    case 'a': if (strcmp(word, "and") == 0)     { return T_AND; }
-    case 'e': if (strcmp(word, "else") == 0)    { return T_ELSE; }
-    case 'f': if (compare_upto(2, word, "fun"))   { return T_FUN; }
-         else if (compare_upto(2, word, "for"))   { return T_FOR; }
-         else if (compare_upto(2, word, "false")) { return T_FALSE; }
-    case 'i': if (strcmp(word, "if") == 0)      { return T_IF; }
-    case 'n': if (strcmp(word, "nil") == 0)     { return T_NIL; }
-    case 'o': if (strcmp(word, "or") == 0)      { return T_OR; }
-    case 't': if (strcmp(word, "true") == 0)    { return T_TRUE; }
-    case 'v': if (strcmp(word, "var") == 0)     { return T_VAR; }
-    case 'w': if (strcmp(word, "while") == 0)   { return T_WHILE; }
-    default:                                    { return 0; }
+static inline unsigned int identifier_end(const char *source, unsigned int size, unsigned int pos) {
+    SCAN_VECTORS(pos, size, identifier_mask(source + pos));
+    while (pos < size && is_identifier_char(source[pos])) {
+        pos++;
     }
+    return pos;
 }
 
-static Token match_identifier(char *source, char *buf, unsigned int source_size, unsigned int *pos) {
-    unsigned int buf_pos = 0;
-    char current;
+static inline unsigned int number_end(const char *source, unsigned int size, unsigned int pos) {
+    SCAN_VECTORS(pos, size, number_mask(source + pos));
+    while (pos < size && is_number_char(source[pos])) {
+        pos++;
+    }
+    return pos;
+}
 
-    while (1) {
-        current = source[*pos];
-        if (is_alpha_num(current) || current == '_') {
-            buf[buf_pos++] = current;
-            (*pos)++;
-        } else {
-            break;
-        }
+static inline unsigned int string_end(const char *source, unsigned int size, unsigned int pos,
+        char quote) {
+    SCAN_VECTORS(pos, size, ~byte_mask(source + pos, quote));
+    while (pos < size && source[pos] != quote) {
+        pos++;
     }
+    return pos;
+}
 
-    buf[buf_pos] = '\0';
 
+/* token matching functions */
+/* empty slots have length 0, which no word has */
+static unsigned int match_keyword(const char *word, unsigned int length) {
+    const Keyword *keyword = &keywords[KEYWORD_SLOT(word[0], word[length - 1], length)];
+
+    if (keyword->length == length && memcmp(word, keyword->text, length) == 0) {
+        return keyword->type;
+    }
+    return 0;
+}
+
+static Token match_identifier(const char *source, unsigned int source_size, unsigned int *pos) {
     Token new_token = create_token();
-    unsigned int keyword = match_keyword(buf);
+    new_token.offset = *pos;
+
+    *pos = identifier_end(source, source_size, *pos);
+    new_token.length = *pos - new_token.offset;
+
+    unsigned int keyword = match_keyword(source + new_token.offset, new_token.length);
 
     if (keyword == T_TRUE || keyword == T_FALSE) {
         new_token.type = T_BOOLEAN;
-        if (keyword == T_TRUE) {
-            new_token.value = malloc(sizeof "true");
-            memcpy(new_token.value, "true", sizeof "true");
-        }
-        if (keyword == T_FALSE) {
-            new_token.value = malloc(sizeof "false");
-            memcpy(new_token.value, "false", sizeof "false");
-        }
-    }
-
-    else if (keyword != 0) {
+    } else if (keyword != 0) {
         new_token.type = keyword;
     } else {
-        new_token.value = malloc(sizeof(char) * (buf_pos + 1));
-        memcpy(new_token.value, buf, buf_pos + 1);
         new_token.type = T_IDENTIFIER;
     }
 
     return new_token;
 }
 
-static Token match_number(char *source, char *buf, unsigned int source_size, unsigned int *pos) {
-    unsigned int buf_pos = 0;
-    char current;
-
-    while (1) {
-        current = source[*pos];
-        if (is_num(current) || current == '.') {
-            buf[buf_pos++] = current;
-            (*pos)++;
-        } else {
-            break;
-        }
-    }
-
-    buf[buf_pos] = '\0';
-
+static Token match_number(const char *source, unsigned int source_size, unsigned int *pos) {
     Token new_token = create_token();
-    new_token.value = malloc(sizeof(char) * (buf_pos + 1));
-    memcpy(new_token.value, buf, buf_pos + 1);
+    new_token.offset = *pos;
 
-    new_token.type = T_NUMBER;
+    *pos = number_end(source, source_size, *pos);
+    new_token.length = *pos - new_token.offset;
+
+    unsigned int integral = memchr(source + new_token.offset, '.', new_token.length) == NULL;
+    new_token.type = integral ? T_INTEGER : T_NUMBER;
 
     return new_token;
 }
 
-static Token match_string(char *source, char *buf, unsigned int source_size, unsigned int *pos) {
-    unsigned int buf_pos = 0;
-    char current = source[*pos];
-    char quote_char = current;
-
-    buf[buf_pos++] = current;
-    (*pos)++;
-
-    do {
-        current = source[(*pos)++];
-        buf[buf_pos++] = current;
-
-        if (*pos > source_size) {
-            break; // TODO fix string overflow
-        }
-    } while (current != quote_char);
-
+/* the token is the text between the quotes. a string missing its closing
+ * quote runs to the end of the source and is an error token */
+static Token match_string(const char *source, unsigned int source_size, unsigned int *pos) {
+    char quote_char = source[(*pos)++];
     Token new_token = create_token();
+    new_token.offset = *pos;
 
-    /* excluding the two quote chars */
-    buf[buf_pos - 1] = '\0';
-    new_token.value = malloc(((buf_pos + 1) - 2) * (sizeof *new_token.value));
-    memcpy(new_token.value, buf + 1, buf_pos - 1);
+    *pos = string_end(source, source_size, *pos, quote_char);
+    new_token.length = *pos - new_token.offset;
 
-    new_token.type = T_STRING;
+    if (*pos < source_size) {
+        new_token.type = T_STRING;
+        (*pos)++;
+    } else {
+        report_error("SyntaxError", "Unterminated string literal");
+        new_token.type = T_ERROR;
+    }
 
     return new_token;
 }
 
-static unsigned int match_symbol(char *source, unsigned int source_size, unsigned int *ind) {
+static unsigned int match_symbol(const char *source, unsigned int source_size, unsigned int *ind) {
     switch(source[*ind]) {
     case '(': return T_LPAREN;
     case ')': return T_RPAREN;
@@ -238,46 +337,73 @@ static unsigned int match_symbol(char *source, unsigned int source_size, unsigne
 
 
 /* public functions */
-TokenArray *tokenize(char *source) {
-    unsigned int source_size = strlen(source);
-    unsigned int pos = 0;
-    char current;
-
-    char char_buf[CHAR_BUF_SZ];
+void init_lexer(Lexer *lexer, const char *source) {
+    lexer->source = source;
+    lexer->size = strlen(source);
+    lexer->pos = 0;
+}
 
-    TokenArray *token_list = create_token_dyn_array();
+Token lex_token(Lexer *lexer) {
+    const char *source = lexer->source;
+    unsigned int source_size = lexer->size;
+    unsigned int pos = lexer->pos;
 
     while (pos < source_size) {
-        current = source[pos];
-        if (is_whitespace(current)) {
-            pos++; continue;
-        }
-
-        if (is_alpha(current)) {
-            Token new_token = match_identifier(source, char_buf, source_size, &pos);
-            append_to_array(token_list, &new_token);
-        }
-
-        else if (is_num(current)) {
-            Token new_token = match_number(source, char_buf, source_size, &pos);
-            append_to_array(token_list, &new_token);
-        }
-
-        else if (is_quote(current)) {
-            Token new_token = match_string(source, char_buf, source_size, &pos);
-            append_to_array(token_list, &new_token);
-        }
-
-        else if (is_symbol(current)) {
-            Token new_token = create_token();
+        Token new_token;
+
+        switch (token_starts[(unsigned char)source[pos]]) {
+        case START_WHITESPACE:
+            pos = skip_whitespace(source, source_size, pos);
+            continue;
+        case START_IDENTIFIER:
+            new_token = match_identifier(source, source_size, &pos);
+            break;
+        case START_NUMBER:
+            new_token = match_number(source, source_size, &pos);
+            break;
+        case START_STRING:
+            new_token = match_string(source, source_size, &pos);
+            break;
+        case START_SYMBOL:
+            new_token = create_token();
+            new_token.offset = pos;
             new_token.type = match_symbol(source, source_size, &pos);
-            append_to_array(token_list, &new_token);
+            new_token.length = pos - new_token.offset + 1;
+            pos++;
+            break;
+        default:
+            /* characters which can't start a token are skipped */
             pos++;
+            continue;
         }
+
+        lexer->pos = pos;
+        return new_token;
     }
 
+    lexer->pos = pos;
     Token eof_token = create_token();
+    eof_token.offset = source_size;
     eof_token.type = T_EOF;
-    append_to_array(token_list, &eof_token);
+    return eof_token;
+}
+
+TokenArray *tokenize(const char *source) {
+    return tokenize_in(NULL, source);
+}
+
+TokenArray *tokenize_in(Arena *arena, const char *source) {
+    Lexer lexer;
+    init_lexer(&lexer, source);
+
+    TokenArray *token_list = create_token_dyn_array(arena);
+    token_list->source = source;
+
+    Token token;
+    do {
+        token = lex_token(&lexer);
+        append_to_array(token_list, &token);
+    } while (token.type != T_EOF);
+
     return token_list;
 }
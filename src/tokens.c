@@ -5,21 +5,22 @@
 
 
 /* public token ops */
-void print_token(Token *token) {
+void print_token(const char *source, Token *token) {
     if (token == NULL) {
         printf("NULL TOKEN\n");
         return;
     }
 
-    if (token->value != NULL) {
-        switch (token->type) {
-        case T_NUMBER: { printf("(NUMBER, '%s')\n", token->value); break; } 
-        case T_IDENTIFIER: { printf("(IDENTIFIER, '%s')\n", token->value); break; }
-        case T_STRING: { printf("(STRING, '%s')\n", token->value); break; }
-        case T_BOOLEAN: { printf("(BOOLEAN, '%s')\n", token->value); break; }
-        default: break;
-        }
-    } else {
+    const char *value = source + token->offset;
+    int length = token->length;
+
+    switch (token->type) {
+    case T_NUMBER: { printf("(NUMBER, '%.*s')\n", length, value); break; }
+    case T_INTEGER: { printf("(INTEGER, '%.*s')\n", length, value); break; }
+    case T_IDENTIFIER: { printf("(IDENTIFIER, '%.*s')\n", length, value); break; }
+    case T_STRING: { printf("(STRING, '%.*s')\n", length, value); break; }
+    case T_BOOLEAN: { printf("(BOOLEAN, '%.*s')\n", length, value); break; }
+    default: {
         const char *symbol;
 
         switch(token->type) {
@@ -75,27 +76,25 @@ void print_token(Token *token) {
         }
 
         printf("(%s, %d)\n", symbol, token->type);
+        break;
+    }
     }
 }
 
 Token create_token() {
     Token t;
-    t.value = NULL;
+    t.offset = 0;
+    t.length = 0;
     t.type = T_NONE;
     t.line = 0;
 
     return t;
 }
 
-void free_token(Token *t) {
-    free(t->value);
-    t->value = NULL;
-    return;
-}
-
 /* dynamic array utils */
-static void grow_array(TokenArray *array, unsigned int new_size) {
-    array->tokens = realloc(array->tokens, (sizeof *array->tokens) * new_size);
+static void grow_array(TokenArray *array, unsigned int old_size, unsigned int new_size) {
+    array->tokens = arena_realloc(array->arena, array->tokens, (sizeof *array->tokens) * old_size,
+            (sizeof *array->tokens) * new_size);
     if (array->tokens == NULL) {
         fputs("error: unable to realloc array\n", stderr);
     }
@@ -103,11 +102,13 @@ static void grow_array(TokenArray *array, unsigned int new_size) {
 
 
 /* public dynarray functions */
-TokenArray *create_token_dyn_array() {
-    TokenArray *array = malloc(sizeof *array);
+TokenArray *create_token_dyn_array(Arena *arena) {
+    TokenArray *array = arena_alloc(arena, sizeof *array);
     array->capacity = DYNARRAY_INITIAL_SIZE;
     array->count = 0;
-    array->tokens = malloc((sizeof *array->tokens) * array->capacity);
+    array->source = NULL;
+    array->arena = arena;
+    array->tokens = arena_alloc(arena, (sizeof *array->tokens) * array->capacity);
     return array;
 }
 
@@ -115,7 +116,7 @@ TokenArray *create_token_dyn_array() {
 void append_to_array(TokenArray *array, Token *t) {
     if (array->count == array->capacity) {
         array->capacity *= DYNARRAY_GROW_BY_FACTOR;
-        grow_array(array, array->capacity);
+        grow_array(array, array->count, array->capacity);
 
         if (array == NULL) {
             printf("got NULL while performing array realloc\n");
@@ -128,9 +129,8 @@ void append_to_array(TokenArray *array, Token *t) {
 }
 
 void free_array(TokenArray *array) {
-    for (int i = 0; i < array->count; i++) {
-        free(array->tokens[i].value);
-        array->tokens[i].value = NULL;
+    if (array->arena != NULL) {
+        return;
     }
 
     free(array->tokens);
@@ -142,7 +142,7 @@ void free_array(TokenArray *array) {
 
 void print_tokens(TokenArray *array) {
     for (unsigned int i = 0; i < array->count; i++) {
-        print_token(&(array->tokens[i]));
+        print_token(array->source, &(array->tokens[i]));
     }
 }
 
@@ -154,7 +154,7 @@ Token *next_token(TokenArray *array, ArrayIterator *iter) {
     #ifdef DEBUG_TOKENS
     if (peek_next_token(array, iter) != NULL) {
         printf("advancing to token: ");
-        print_token(&array->tokens[iter->index + 1]);
+        print_token(array->source, &array->tokens[iter->index + 1]);
     }
     #endif
 
@@ -172,7 +172,7 @@ Token *peek_next_token(TokenArray *array, ArrayIterator *iter) {
 
     #ifdef DEBUG_TOKENS
     printf("peeking next token: ");
-    print_token(&array->tokens[iter->index + 1]);
+    print_token(array->source, &array->tokens[iter->index + 1]);
     #endif
 
     return &(array->tokens[iter->index + 1]);
@@ -185,7 +185,7 @@ Token *current_token(TokenArray *array, ArrayIterator *iter) {
 
     #ifdef DEBUG_TOKENS
     printf("current token: ");
-    print_token(&array->tokens[iter->index]);
+    print_token(array->source, &array->tokens[iter->index]);
     #endif
 
     return &(array->tokens[iter->index]);
@@ -202,7 +202,7 @@ void print_tokens2(TokenArray *array) {
     // ArrayIterator iter = { array->count, 0 };
 
     foreach(t, array) {
-        print_token(t);
+        print_token(array->source, t);
     }
 }
 #undef foreach
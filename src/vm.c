@@ -1,35 +1,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "arith.h"
 #include "vm.h"
 
 void push(Stack *s, Value val) {
-    s->head &= s->size - 1;
     s->at[s->head++] = val;
 #ifdef DEBUG_STACK
-    if (val.type == VAL_TYPE_DOUBLE) {
-        printf("pushing double '%lf'. stack head now at %d\n", val.as.real, s->head);
-    } else if (val.type == VAL_TYPE_INTEGER) {
-        printf("pushing int '%ld'. stack head now at %d\n", val.as.integer, s->head);
-    } else if (val.type == VAL_TYPE_STRING) {
-        printf("pushing string '%s'. stack head now at %d\n", val.as.string, s->head);
+    if (IS_DOUBLE(val)) {
+        printf("pushing double '%lf'. stack head now at %d\n", AS_DOUBLE(val), s->head);
+    } else if (IS_INTEGER(val)) {
+        printf("pushing int '%ld'. stack head now at %d\n", AS_INTEGER(val), s->head);
+    } else if (IS_STRING(val)) {
+        printf("pushing string '%s'. stack head now at %d\n", AS_STRING(val), s->head);
     }
 #endif
 }
 
 Value pop(Stack *s) {
-    s->head &= s->size - 1;
     s->head--;
 
 #ifdef DEBUG_STACK
     Value val = s->at[s->head];
-    if (val.type == VAL_TYPE_DOUBLE) {
-        printf("popping double '%lf'. stack head now at %d\n", val.as.real, s->head);
-    } else if (val.type == VAL_TYPE_INTEGER) {
-        printf("popping int '%ld'. stack head now at %d\n", val.as.integer, s->head);
-    } else if (val.type == VAL_TYPE_STRING) {
-        printf("popping string '%s'. stack head now at %d\n", val.as.string, s->head);
+    if (IS_DOUBLE(val)) {
+        printf("popping double '%lf'. stack head now at %d\n", AS_DOUBLE(val), s->head);
+    } else if (IS_INTEGER(val)) {
+        printf("popping int '%ld'. stack head now at %d\n", AS_INTEGER(val), s->head);
+    } else if (IS_STRING(val)) {
+        printf("popping string '%s'. stack head now at %d\n", AS_STRING(val), s->head);
     }
 
     return val;
@@ -38,180 +38,533 @@ Value pop(Stack *s) {
 #endif
 }
 
-/* opcodes */
-static void op_add(Stack *s) {
-    Value a = pop(s);
-    Value b = pop(s);
+/* One extra slot is allocated below at[0] so that evaluate() can always spill
+ * its cached top of stack, even when the stack is empty. */
+static Stack initialize_stack() {
+    Stack stack;
+    Value *slots = malloc((sizeof *slots) * (STACK_INITIAL_SIZE + 1));
+    slots[0] = nil_value();
+    stack.at = slots + 1;
+    stack.head = 0;
+    stack.size = STACK_INITIAL_SIZE;
 
-#ifdef DEBUG_STACK
-    if (a.type == VAL_TYPE_INTEGER) {
-        printf("value a is of type int\n");
-    } else if (a.type == VAL_TYPE_DOUBLE) {
-        printf("value a is of type double: %lf\n", a.as.real);
+    return stack;
+}
+
+/* moves the stack, along with its guard slot, to an allocation of size values */
+static int relocate_stack(Stack *s, unsigned int size) {
+    Value *slots = realloc(s->at - 1, (sizeof *slots) * (size + 1));
+    if (slots == NULL) {
+        return 0;
     }
 
-    if (b.type == VAL_TYPE_INTEGER) {
-        printf("value b is of type int\n");
-    } else if (b.type == VAL_TYPE_DOUBLE) {
-        printf("value b is of type double: %lf\n", b.as.real);
+    s->at = slots + 1;
+    s->size = size;
+    return 1;
+}
+
+int reserve_stack(Stack *s, unsigned int slots) {
+    if (slots <= s->size - s->head) {
+        return 1;
+    }
+    if (slots > STACK_MAX_SIZE - s->head) {
+        return 0;
     }
-#endif /* DEBUG_STACK */
 
-    if (a.type == VAL_TYPE_DOUBLE && b.type == VAL_TYPE_DOUBLE) {
-        push(s, double_value(a.as.real + b.as.real));
-    } else if (a.type == VAL_TYPE_INTEGER && b.type == VAL_TYPE_INTEGER) {
-        push(s, int_value(a.as.integer + b.as.integer));
-    } else if (a.type == VAL_TYPE_STRING && b.type == VAL_TYPE_STRING) {
-        push(s, add_strings(&a, &b));
-    } else {
-        // error
+    unsigned int needed = s->head + slots;
+    unsigned int size = s->size;
+    while (size < needed) {
+        size *= 2;
     }
+
+    return relocate_stack(s, size);
 }
 
-static void op_sub(Stack *s) {
-    Value a = pop(s);
-    Value b = pop(s);
+void shrink_stack(Stack *s) {
+    unsigned int size = s->size;
+    while (size > STACK_INITIAL_SIZE && size / 2 >= s->head) {
+        size /= 2;
+    }
 
-    if (a.type == VAL_TYPE_DOUBLE && b.type == VAL_TYPE_DOUBLE) {
-        push(s, double_value(b.as.real - a.as.real));
-    } else if (a.type == VAL_TYPE_INTEGER && b.type == VAL_TYPE_INTEGER) {
-        push(s, int_value(b.as.integer - a.as.integer));
-    } else {
-        // error
+    if (size != s->size) {
+        relocate_stack(s, size);
     }
 }
 
-static void op_mult(Stack *s) {
-    Value a = pop(s);
-    Value b = pop(s);
+static void free_stack(Stack *s) {
+    free(s->at - 1);
+    s->at = NULL;
+}
 
-    if (a.type == VAL_TYPE_DOUBLE && b.type == VAL_TYPE_DOUBLE) {
-        push(s, double_value(a.as.real * b.as.real));
-    } else if (a.type == VAL_TYPE_INTEGER && b.type == VAL_TYPE_INTEGER) {
-        push(s, int_value(a.as.integer * b.as.integer));
-    } else {
-        // error
-    }
+VirtualMachine initialize_vm() {
+    VirtualMachine vm;
+    vm.stack = initialize_stack();
+    vm.symbols = init_table();
+    vm.names = create_name_dynarray();
+    vm.globals = create_value_dynarray(NULL);
+    vm.env = init_table();
+    vm.shared = NULL;
+    init_arena(&vm.compile_arena, ARENA_DEFAULT_BLOCK_SIZE);
+    vm.stats = (VMStats) { 0, 0, 0 };
+    vm.options = (VMOptions) { 1, ENGINE_STACK };
+    vm.ip = 0;
+    vm.state = 0;
+    return vm;
 }
 
-static void op_div(Stack *s) {
-    Value a = pop(s);
-    Value b = pop(s);
+/* globals */
+
+/* globals has a slot per name but is a ValueArray, which holds at most
+ * MAX_CHUNK_CONSTANTS values */
+_Static_assert(MAX_CHUNK_NAMES <= MAX_CHUNK_CONSTANTS, "every name needs a global slot");
 
-    if (a.type == VAL_TYPE_DOUBLE && b.type == VAL_TYPE_DOUBLE) {
-        push(s, double_value(b.as.real / a.as.real));
-    } else if (a.type == VAL_TYPE_INTEGER && b.type == VAL_TYPE_INTEGER) {
-        push(s, int_value(b.as.integer / a.as.integer));
-    } else {
-        // error
+void reserve_globals(VirtualMachine *vm) {
+    while (vm->globals->elements < vm->names.elements) {
+        if (!append_to_value_dynarray(vm->globals, undefined_value())) {
+            break;
+        }
     }
 }
 
-static void op_cmp(Stack *s) {
-    Value b = pop(s);
-    Value a = pop(s);
+void define_global(VirtualMachine *vm, unsigned int slot, Value value) {
+    if (IS_UNDEFINED(vm->globals->array[slot])) {
+        upsert_entry(vm->env, vm->names.array[slot], int_value(slot));
+    }
+    vm->globals->array[slot] = value;
+}
+
+void attach_shared_globals(VirtualMachine *vm, SharedTable *shared) {
+    vm->shared = shared;
+}
 
-    if (a.type == VAL_TYPE_DOUBLE && b.type == VAL_TYPE_DOUBLE) {
-        push(s, bool_value(b.as.real == a.as.real));
-    } else if (a.type == VAL_TYPE_STRING && b.type == VAL_TYPE_STRING) {
-        push(s, bool_value(strcmp(a.as.string, b.as.string) == 0));
-    } else {
-        report_error("TypeError", "Incompatible types for '=='");
-        // error
+int get_shared_global(VirtualMachine *vm, unsigned int slot, Value *value) {
+    if (vm->shared == NULL) {
+        return 0;
     }
+    NameKey key = vm->names.keys[slot];
+    return shared_table_get_hashed(vm->shared, vm->names.array[slot], key.hash, key.length, value);
 }
 
+Value *get_global(VirtualMachine *vm, char *name) {
+    Entry *e = get_entry(vm->env, name);
+    if (e == NULL) {
+        return NULL;
+    }
+    return &vm->globals->array[AS_INTEGER(e->value)];
+}
 
-static Stack initialize_stack() {
-    Stack stack;
-    stack.at = malloc((sizeof *stack.at) * STACK_SIZE);
-    stack.head = 0;
-    stack.size = STACK_SIZE;
+/* quickening */
 
-    return stack;
+/* returns the form of a generic arithmetic opcode specialized to the types of
+ * a and b, or op itself if there is none */
+static opcode_t specialize(opcode_t op, Value a, Value b) {
+    unsigned int doubles = IS_DOUBLE(a) && IS_DOUBLE(b);
+    unsigned int integers = IS_INTEGER(a) && IS_INTEGER(b);
+
+    switch (op) {
+    case OP_ADD:
+        if (doubles) return OP_ADD_DD;
+        if (integers) return OP_ADD_II;
+        if (IS_STRING(a) && IS_STRING(b)) return OP_ADD_SS;
+        break;
+    case OP_SUB:
+        if (doubles) return OP_SUB_DD;
+        if (integers) return OP_SUB_II;
+        break;
+    case OP_MULT:
+        if (doubles) return OP_MULT_DD;
+        if (integers) return OP_MULT_II;
+        break;
+    case OP_DIV:
+        if (doubles) return OP_DIV_DD;
+        if (integers) return OP_DIV_II;
+        break;
+    case OP_ADD_CONST:
+        if (doubles) return OP_ADD_CONST_DD;
+        if (integers) return OP_ADD_CONST_II;
+        break;
+    case OP_SUB_CONST:
+        if (doubles) return OP_SUB_CONST_DD;
+        if (integers) return OP_SUB_CONST_II;
+        break;
+    case OP_MULT_CONST:
+        if (doubles) return OP_MULT_CONST_DD;
+        if (integers) return OP_MULT_CONST_II;
+        break;
+    case OP_DIV_CONST:
+        if (doubles) return OP_DIV_CONST_DD;
+        if (integers) return OP_DIV_CONST_II;
+        break;
+    }
+
+    return op;
 }
 
-static void free_stack(Stack *s) {
-    free(s->at);
-    s->at = NULL;
+static inline void quicken(VirtualMachine *vm, uint8_t *site, Value a, Value b) {
+    opcode_t op = specialize(*site, a, b);
+    if (op != *site) {
+        *site = op;
+        vm->stats.quickened++;
+    }
 }
 
-VirtualMachine initialize_vm() {
-    VirtualMachine vm;
-    vm.stack = initialize_stack();
-    vm.names = create_name_dynarray();
-    vm.env = init_table();
-    vm.ip = 0;
-    vm.state = 0;
-    return vm;
+static inline void deoptimize(VirtualMachine *vm, uint8_t *site, opcode_t generic) {
+    *site = generic;
+    vm->stats.deoptimized++;
 }
 
-uint8_t next(uint8_t *ip) {
-    return *(++ip);
+/* memory */
+void vm_memory_usage(VirtualMachine *vm, VMMemory *memory) {
+    memory->env = table_memory_usage(vm->env);
+    memory->symbols = table_memory_usage(vm->symbols);
+    memory->globals = vm->globals->capacity * sizeof *vm->globals->array;
+    memory->stack = (vm->stack.size + 1) * sizeof *vm->stack.at;
+    memory->compile_arena = arena_memory_usage(&vm->compile_arena);
 }
 
+void compact_vm(VirtualMachine *vm) {
+    table_compact(vm->env);
+    table_compact(vm->symbols);
+    shrink_stack(&vm->stack);
+    free_arena(&vm->compile_arena);
+}
+
+void print_vm_stats(VirtualMachine *vm) {
+    printf("quickened: %lu\n", vm->stats.quickened);
+    printf("deoptimized: %lu\n", vm->stats.deoptimized);
+#ifdef COUNT_INSTRUCTIONS
+    printf("instructions: %lu\n", vm->stats.instructions);
+#endif /* COUNT_INSTRUCTIONS */
+
+    TableStats env;
+    table_stats(vm->env, &env);
+    printf("env: %u entries, %u holes, capacity %u, max probe %u, %zu bytes\n",
+            env.elements, env.holes, env.capacity, env.max_probe, env.memory);
+
+    VMMemory memory;
+    vm_memory_usage(vm, &memory);
+    printf("memory: env %zu, symbols %zu, globals %zu, stack %zu, compile arena %zu bytes\n",
+            memory.env, memory.symbols, memory.globals, memory.stack, memory.compile_arena);
+}
+
+/* dispatch
+ *
+ * evaluate() keeps the top of the stack in the local tos and the address of
+ * the slot below it in sp, so handlers which consume their operands and push
+ * a result, like the arithmetic opcodes, never touch memory for the top value.
+ * The stack in memory is at[0] up to sp, exclusive, and tos is logically
+ * *sp. An empty stack has sp pointing at the guard slot below at[0]. */
+#define READ_BYTE() (*ip++)
+#define PUSH(val) do { *sp++ = tos; tos = (val); } while (0)
+#define DROP() (tos = *--sp)
+
+/* writes the cached top back so that stack->head is accurate again */
+#define SPILL()                            \
+    do {                                   \
+        *sp = tos;                         \
+        stack->head = sp - stack->at + 1;  \
+    } while (0)
+
+/* a runtime error unwinds everything this call pushed */
+#define RUNTIME_ERROR(type, ...)              \
+    do {                                      \
+        report_error(type, __VA_ARGS__);      \
+        stack->head = base;                   \
+        return;                               \
+    } while (0)
+
+#ifdef COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTION() vm->stats.instructions++
+#else
+#define COUNT_INSTRUCTION() (void)0
+#endif /* COUNT_INSTRUCTIONS */
+
+#ifdef THREADED_DISPATCH
+#define TARGET(op) target_##op
+#define DISPATCH() do { COUNT_INSTRUCTION(); goto *dispatch_table[READ_BYTE()]; } while (0)
+#else
+#define TARGET(op) case op
+#define DISPATCH() break
+#endif /* THREADED_DISPATCH */
+
+/* generic arithmetic handler: specializes the opcode at this site to the
+ * operand types before computing the result */
+#define GENERIC_ARITH(fn, symbol)                                             \
+    do {                                                                      \
+        Value b = tos;                                                        \
+        Value a = *--sp;                                                      \
+        quicken(vm, ip - 1, a, b);                                            \
+        if (!fn(a, b, &tos)) {                                                \
+            RUNTIME_ERROR("TypeError", "Incompatible types for '" symbol "'"); \
+        }                                                                     \
+    } while (0)
+
+/* superinstruction handler: applies fn to the top of the stack and the
+ * constant operand, specializing the opcode like GENERIC_ARITH */
+#define CONSTANT_ARITH(fn, symbol)                                            \
+    do {                                                                      \
+        Value b = constants[*ip];                                             \
+        Value a = tos;                                                        \
+        quicken(vm, ip - 1, a, b);                                            \
+        ip++;                                                                 \
+        if (!fn(a, b, &tos)) {                                                \
+            RUNTIME_ERROR("TypeError", "Incompatible types for '" symbol "'"); \
+        }                                                                     \
+    } while (0)
+
+/* specialized arithmetic handler: computes expr if both operands pass guard,
+ * otherwise rewrites the site back to the generic opcode */
+#define SPECIALIZED_ARITH(guard, expr, generic, fn, symbol)                   \
+    do {                                                                      \
+        Value b = tos;                                                        \
+        Value a = *--sp;                                                      \
+        if (guard(a) && guard(b)) {                                           \
+            tos = expr;                                                       \
+            break;                                                            \
+        }                                                                     \
+        deoptimize(vm, ip - 1, generic);                                      \
+        if (!fn(a, b, &tos)) {                                                \
+            RUNTIME_ERROR("TypeError", "Incompatible types for '" symbol "'"); \
+        }                                                                     \
+    } while (0)
+
+/* specialized superinstruction handler: as SPECIALIZED_ARITH with the
+ * constant operand, rewriting the site back to the generic superinstruction */
+#define SPECIALIZED_CONSTANT_ARITH(guard, expr, generic, fn, symbol)          \
+    do {                                                                      \
+        Value b = constants[READ_BYTE()];                                     \
+        Value a = tos;                                                        \
+        if (guard(a) && guard(b)) {                                           \
+            tos = expr;                                                       \
+            break;                                                            \
+        }                                                                     \
+        deoptimize(vm, ip - 2, generic);                                      \
+        if (!fn(a, b, &tos)) {                                                \
+            RUNTIME_ERROR("TypeError", "Incompatible types for '" symbol "'"); \
+        }                                                                     \
+    } while (0)
+
 void evaluate(VirtualMachine *vm, BytecodeArray *bytecode) {
     uint8_t *ip = bytecode->array;
-    unsigned int size = bytecode->elements;
-    Entry *var;
+    Value *constants = bytecode->constants->array;
+    Stack *stack = &vm->stack;
 
-    for (int i = 0; i < size; i++) {
-        switch (bytecode->array[i]) {
-        case OP_RETURN:
-            break;
-        case OP_CONSTANT:
-            push(&vm->stack, bytecode->constants->array[bytecode->array[i + 1]]);
-            i++;
-            break;
-        case OP_GET_GLOBAL:
-            var = get_entry(vm->env, vm->names.array[bytecode->array[i + 1]]);
-            if (var != NULL) {
-                push(&vm->stack, get_entry(vm->env, vm->names.array[bytecode->array[i + 1]])->value);
-            } else {
-                report_error("RuntimeError",
-                        "variable '%s' not found",
-                        vm->names.array[bytecode->array[i+1]]);
-                break;
+    if (!reserve_stack(stack, bytecode->max_stack)) {
+        report_error("RuntimeError", "stack overflow");
+        return;
+    }
+
+    unsigned int base = stack->head;
+    Value *sp = (stack->at + base) - 1;
+    Value tos = *sp;
+
+    reserve_globals(vm);
+    Value *globals = vm->globals->array;
+
+#ifdef THREADED_DISPATCH
+    static void *dispatch_table[256] = {
+        [0 ... 255]        = &&target_unknown,
+        [OP_RETURN]        = &&target_OP_RETURN,
+        [OP_CONSTANT]      = &&target_OP_CONSTANT,
+        [OP_GET_GLOBAL]    = &&target_OP_GET_GLOBAL,
+        [OP_SET_GLOBAL]    = &&target_OP_SET_GLOBAL,
+        [OP_UPDATE_GLOBAL] = &&target_OP_UPDATE_GLOBAL,
+        [OP_ADD]           = &&target_OP_ADD,
+        [OP_SUB]           = &&target_OP_SUB,
+        [OP_MULT]          = &&target_OP_MULT,
+        [OP_DIV]           = &&target_OP_DIV,
+        [OP_CMP]           = &&target_OP_CMP,
+        [OP_NEGATE]        = &&target_OP_NEGATE,
+        [OP_ADD_DD]        = &&target_OP_ADD_DD,
+        [OP_ADD_II]        = &&target_OP_ADD_II,
+        [OP_ADD_SS]        = &&target_OP_ADD_SS,
+        [OP_SUB_DD]        = &&target_OP_SUB_DD,
+        [OP_SUB_II]        = &&target_OP_SUB_II,
+        [OP_MULT_DD]       = &&target_OP_MULT_DD,
+        [OP_MULT_II]       = &&target_OP_MULT_II,
+        [OP_DIV_DD]        = &&target_OP_DIV_DD,
+        [OP_DIV_II]        = &&target_OP_DIV_II,
+        [OP_ADD_CONST]     = &&target_OP_ADD_CONST,
+        [OP_SUB_CONST]     = &&target_OP_SUB_CONST,
+        [OP_MULT_CONST]    = &&target_OP_MULT_CONST,
+        [OP_DIV_CONST]     = &&target_OP_DIV_CONST,
+        [OP_CMP_CONST]     = &&target_OP_CMP_CONST,
+        [OP_GET_GLOBAL2]   = &&target_OP_GET_GLOBAL2,
+        [OP_ADD_CONST_DD]  = &&target_OP_ADD_CONST_DD,
+        [OP_ADD_CONST_II]  = &&target_OP_ADD_CONST_II,
+        [OP_SUB_CONST_DD]  = &&target_OP_SUB_CONST_DD,
+        [OP_SUB_CONST_II]  = &&target_OP_SUB_CONST_II,
+        [OP_MULT_CONST_DD] = &&target_OP_MULT_CONST_DD,
+        [OP_MULT_CONST_II] = &&target_OP_MULT_CONST_II,
+        [OP_DIV_CONST_DD]  = &&target_OP_DIV_CONST_DD,
+        [OP_DIV_CONST_II]  = &&target_OP_DIV_CONST_II,
+    };
+
+    DISPATCH();
+#else
+    for (;;) {
+        COUNT_INSTRUCTION();
+        switch (READ_BYTE()) {
+#endif /* THREADED_DISPATCH */
+        TARGET(OP_RETURN):
+            SPILL();
+            return;
+        TARGET(OP_CONSTANT):
+            PUSH(constants[READ_BYTE()]);
+            DISPATCH();
+        TARGET(OP_GET_GLOBAL): {
+            uint8_t slot = READ_BYTE();
+            Value value = globals[slot];
+            if (IS_UNDEFINED(value) && !get_shared_global(vm, slot, &value)) {
+                RUNTIME_ERROR("RuntimeError", "variable '%s' not found", vm->names.array[slot]);
             }
-            i++;
-            break;
-        case OP_SET_GLOBAL:
-            add_entry(vm->env, vm->names.array[bytecode->array[i + 1]], pop(&vm->stack));
-            i++;
-            break;
-        case OP_UPDATE_GLOBAL:
-            var = get_entry(vm->env, vm->names.array[bytecode->array[i + 1]]);
-            if (var != NULL) {
-                var->value = pop(&vm->stack);
-            } else {
-                report_error("RuntimeError",
-                        "variable '%s' not found",
-                        vm->names.array[bytecode->array[i+1]]);
-                break;
+            PUSH(value);
+            DISPATCH();
+        }
+        TARGET(OP_SET_GLOBAL):
+            define_global(vm, READ_BYTE(), tos);
+            DROP();
+            DISPATCH();
+        TARGET(OP_UPDATE_GLOBAL): {
+            uint8_t slot = READ_BYTE();
+            if (IS_UNDEFINED(globals[slot])) {
+                RUNTIME_ERROR("RuntimeError", "variable '%s' not found", vm->names.array[slot]);
             }
-            i++;
-            break;
-        case OP_ADD:
-            op_add(&vm->stack);
-            break;
-        case OP_SUB:
-            op_sub(&vm->stack);
-            break;
-        case OP_MULT:
-            op_mult(&vm->stack);
-            break;
-        case OP_DIV:
-            op_div(&vm->stack);
-            break;
-        case OP_CMP:
-            op_cmp(&vm->stack);
-            break;
+            globals[slot] = tos;
+            DROP();
+            DISPATCH();
+        }
+        TARGET(OP_ADD):
+            GENERIC_ARITH(arith_add, "+");
+            DISPATCH();
+        TARGET(OP_SUB):
+            GENERIC_ARITH(arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_MULT):
+            GENERIC_ARITH(arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_DIV):
+            GENERIC_ARITH(arith_div, "/");
+            DISPATCH();
+        TARGET(OP_ADD_DD):
+            SPECIALIZED_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) + AS_DOUBLE(b)), OP_ADD, arith_add, "+");
+            DISPATCH();
+        TARGET(OP_ADD_II):
+            SPECIALIZED_ARITH(IS_INTEGER, int_add(AS_INTEGER(a), AS_INTEGER(b)), OP_ADD, arith_add, "+");
+            DISPATCH();
+        TARGET(OP_ADD_SS):
+            SPECIALIZED_ARITH(IS_STRING, add_strings(&b, &a), OP_ADD, arith_add, "+");
+            DISPATCH();
+        TARGET(OP_SUB_DD):
+            SPECIALIZED_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) - AS_DOUBLE(b)), OP_SUB, arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_SUB_II):
+            SPECIALIZED_ARITH(IS_INTEGER, int_sub(AS_INTEGER(a), AS_INTEGER(b)), OP_SUB, arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_MULT_DD):
+            SPECIALIZED_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) * AS_DOUBLE(b)), OP_MULT, arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_MULT_II):
+            SPECIALIZED_ARITH(IS_INTEGER, int_mult(AS_INTEGER(a), AS_INTEGER(b)), OP_MULT, arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_DIV_DD):
+            SPECIALIZED_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) / AS_DOUBLE(b)), OP_DIV, arith_div, "/");
+            DISPATCH();
+        TARGET(OP_DIV_II):
+            SPECIALIZED_ARITH(IS_INTEGER, int_div(AS_INTEGER(a), AS_INTEGER(b)), OP_DIV, arith_div, "/");
+            DISPATCH();
+        TARGET(OP_CMP): {
+            Value b = tos;
+            Value a = *--sp;
+            if (!arith_cmp(a, b, &tos)) {
+                RUNTIME_ERROR("TypeError", "Incompatible types for '=='");
+            }
+            DISPATCH();
+        }
+        TARGET(OP_NEGATE):
+            if (!arith_negate(tos, &tos)) {
+                RUNTIME_ERROR("TypeError", "Incompatible type for unary '-'");
+            }
+            DISPATCH();
+        TARGET(OP_ADD_CONST):
+            CONSTANT_ARITH(arith_add, "+");
+            DISPATCH();
+        TARGET(OP_SUB_CONST):
+            CONSTANT_ARITH(arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_MULT_CONST):
+            CONSTANT_ARITH(arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_DIV_CONST):
+            CONSTANT_ARITH(arith_div, "/");
+            DISPATCH();
+        TARGET(OP_CMP_CONST):
+            CONSTANT_ARITH(arith_cmp, "==");
+            DISPATCH();
+        TARGET(OP_ADD_CONST_DD):
+            SPECIALIZED_CONSTANT_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) + AS_DOUBLE(b)), OP_ADD_CONST, arith_add, "+");
+            DISPATCH();
+        TARGET(OP_ADD_CONST_II):
+            SPECIALIZED_CONSTANT_ARITH(IS_INTEGER, int_add(AS_INTEGER(a), AS_INTEGER(b)), OP_ADD_CONST, arith_add, "+");
+            DISPATCH();
+        TARGET(OP_SUB_CONST_DD):
+            SPECIALIZED_CONSTANT_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) - AS_DOUBLE(b)), OP_SUB_CONST, arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_SUB_CONST_II):
+            SPECIALIZED_CONSTANT_ARITH(IS_INTEGER, int_sub(AS_INTEGER(a), AS_INTEGER(b)), OP_SUB_CONST, arith_sub, "-");
+            DISPATCH();
+        TARGET(OP_MULT_CONST_DD):
+            SPECIALIZED_CONSTANT_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) * AS_DOUBLE(b)), OP_MULT_CONST, arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_MULT_CONST_II):
+            SPECIALIZED_CONSTANT_ARITH(IS_INTEGER, int_mult(AS_INTEGER(a), AS_INTEGER(b)), OP_MULT_CONST, arith_mult, "*");
+            DISPATCH();
+        TARGET(OP_DIV_CONST_DD):
+            SPECIALIZED_CONSTANT_ARITH(IS_DOUBLE, double_value(AS_DOUBLE(a) / AS_DOUBLE(b)), OP_DIV_CONST, arith_div, "/");
+            DISPATCH();
+        TARGET(OP_DIV_CONST_II):
+            SPECIALIZED_CONSTANT_ARITH(IS_INTEGER, int_div(AS_INTEGER(a), AS_INTEGER(b)), OP_DIV_CONST, arith_div, "/");
+            DISPATCH();
+        TARGET(OP_GET_GLOBAL2): {
+            uint8_t first = READ_BYTE();
+            uint8_t second = READ_BYTE();
+            Value a = globals[first];
+            Value b = globals[second];
+            if (IS_UNDEFINED(a) && !get_shared_global(vm, first, &a)) {
+                RUNTIME_ERROR("RuntimeError", "variable '%s' not found", vm->names.array[first]);
+            }
+            if (IS_UNDEFINED(b) && !get_shared_global(vm, second, &b)) {
+                RUNTIME_ERROR("RuntimeError", "variable '%s' not found", vm->names.array[second]);
+            }
+            PUSH(a);
+            PUSH(b);
+            DISPATCH();
+        }
+#ifdef THREADED_DISPATCH
+        target_unknown:
+#else
         default:
-            printf("unknown instruction\n");
+#endif /* THREADED_DISPATCH */
+            RUNTIME_ERROR("RuntimeError", "unknown instruction %02x", ip[-1]);
+#ifndef THREADED_DISPATCH
         }
     }
+#endif /* THREADED_DISPATCH */
 }
 
+#undef READ_BYTE
+#undef PUSH
+#undef DROP
+#undef SPILL
+#undef RUNTIME_ERROR
+#undef COUNT_INSTRUCTION
+#undef TARGET
+#undef DISPATCH
+#undef GENERIC_ARITH
+#undef CONSTANT_ARITH
+#undef SPECIALIZED_ARITH
+#undef SPECIALIZED_CONSTANT_ARITH
+
 unsigned int execute(VirtualMachine *vm, BytecodeArray *bytecode) {
     if (vm == NULL || bytecode == NULL || bytecode->array == NULL) {
         return 0;
@@ -224,6 +577,7 @@ unsigned int execute(VirtualMachine *vm, BytecodeArray *bytecode) {
         print_value(&v);
         printf("\n");
     }
+    shrink_stack(&vm->stack);
 #ifdef DEBUG_TABLE
     printf("--- contents of env ---\n");
     print_table(vm->env);
@@ -234,7 +588,11 @@ unsigned int execute(VirtualMachine *vm, BytecodeArray *bytecode) {
 void free_vm(VirtualMachine *vm) {
     free_stack(&vm->stack);
     free_name_dynarray(&vm->names);
+    free_table_keys(vm->symbols);
+    free_table(vm->symbols);
+    free_value_dynarray(vm->globals);
     free_table(vm->env);
+    free_arena(&vm->compile_arena);
 }
 
 #ifdef DEBUG_STACK
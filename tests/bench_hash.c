@@ -0,0 +1,69 @@
+/* Hash throughput microbenchmark: compares hash_bytes() with the byte at a time
+ * FNV-1 hash the tables used before, on 8, 32 and 256 byte keys.
+ *
+ * run with `make bench-hash` */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+#define FNV1_32_INIT 2166136261u
+#define FNV1_32_PRIME 16777619u
+
+#define BENCH_BYTES (256u * 1024 * 1024)
+#define BENCH_KEYS 1024
+
+static uint32_t fnv1_hash(const void *bytes, size_t length) {
+    const unsigned char *p = bytes;
+    uint32_t hash = FNV1_32_INIT;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= FNV1_32_PRIME;
+    }
+
+    return hash;
+}
+
+static double now_seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* hashes BENCH_BYTES worth of keys of the given length and prints ns per key
+ * and throughput */
+static void bench(const char *name, uint32_t (*hash)(const void *, size_t),
+        const char *keys, size_t length) {
+    unsigned long iterations = BENCH_BYTES / length;
+    uint32_t sink = 0;
+
+    double start = now_seconds();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += hash(keys + (i % BENCH_KEYS) * length, length);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-10s %4zu bytes  %8.2f ns/key  %8.1f MB/s  (%08x)\n", name, length,
+            elapsed * 1e9 / iterations, BENCH_BYTES / elapsed / 1e6, sink);
+}
+
+int main() {
+    static const size_t lengths[] = { 8, 32, 256 };
+
+    for (unsigned int i = 0; i < sizeof lengths / sizeof *lengths; i++) {
+        size_t length = lengths[i];
+        char *keys = malloc(BENCH_KEYS * length);
+        for (size_t j = 0; j < BENCH_KEYS * length; j++) {
+            keys[j] = 'a' + rand() % 26;
+        }
+
+        bench("fnv1", fnv1_hash, keys, length);
+        bench("hash_bytes", hash_bytes, keys, length);
+        free(keys);
+    }
+
+    return 0;
+}
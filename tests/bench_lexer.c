@@ -0,0 +1,183 @@
+/* Lexer throughput microbenchmark: tokenizes generated sources of a few shapes
+ * and prints MB/s and tokens/s for each.
+ *
+ * run with `make bench-lexer`, or `make bench-lexer BENCH_LEXER_ARGS=--size-mb=N`
+ * to change the size of each source (default 16 MB) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "tokenize.h"
+
+#define BENCH_REPEATS 5
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*generate)(char *out, size_t size);
+} Workload;
+
+static const char *short_names[] = { "x", "i", "sum", "count", "total", "a1", "left", "right" };
+static const char *long_names[] = {
+    "accumulated_interest_rate", "number_of_outstanding_requests", "previous_frame_timestamp",
+    "maximum_retry_backoff_delay", "configuration_reload_interval", "average_response_latency",
+};
+static const char *operators[] = { " + ", " - ", " * ", " / ", " == ", " <= ", " != ", " += " };
+
+static unsigned int next_random(unsigned int *state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+/* appends text to out at *length, returning 0 once out is full */
+static int append(char *out, size_t size, size_t *length, const char *text) {
+    size_t n = strlen(text);
+    if (*length + n >= size) {
+        return 0;
+    }
+    memcpy(out + *length, text, n);
+    *length += n;
+    return 1;
+}
+
+/* statements like `var count = sum * 42 + x - 3.25` on indented lines */
+static void generate_code(char *out, size_t size) {
+    unsigned int seed = 1;
+    size_t length = 0;
+    char number[32];
+
+    for (int ok = 1; ok;) {
+        ok = append(out, size, &length, "    var ");
+        ok = ok && append(out, size, &length, short_names[next_random(&seed) % 8]);
+        ok = ok && append(out, size, &length, " = ");
+        for (unsigned int i = 0; ok && i < 4; i++) {
+            if (next_random(&seed) % 3 == 0) {
+                snprintf(number, sizeof number, "%u.%u", next_random(&seed) % 1000, next_random(&seed) % 100);
+                ok = append(out, size, &length, number);
+            } else if (next_random(&seed) % 2 == 0) {
+                snprintf(number, sizeof number, "%u", next_random(&seed));
+                ok = append(out, size, &length, number);
+            } else {
+                ok = append(out, size, &length, short_names[next_random(&seed) % 8]);
+            }
+            ok = ok && append(out, size, &length, i < 3 ? operators[next_random(&seed) % 8] : "\n");
+        }
+    }
+    out[length] = '\0';
+}
+
+/* long descriptive identifiers separated by operators */
+static void generate_identifiers(char *out, size_t size) {
+    unsigned int seed = 2;
+    size_t length = 0;
+
+    while (append(out, size, &length, long_names[next_random(&seed) % 6])
+            && append(out, size, &length, operators[next_random(&seed) % 8])) {
+    }
+    out[length] = '\0';
+}
+
+/* string literals of 16 to 80 characters */
+static void generate_strings(char *out, size_t size) {
+    unsigned int seed = 3;
+    size_t length = 0;
+    char literal[96];
+
+    for (;;) {
+        unsigned int n = 16 + next_random(&seed) % 64;
+        literal[0] = '"';
+        for (unsigned int i = 1; i <= n; i++) {
+            literal[i] = next_random(&seed) % 6 == 0 ? ' ' : 'a' + next_random(&seed) % 26;
+        }
+        literal[n + 1] = '"';
+        literal[n + 2] = '\0';
+
+        if (!append(out, size, &length, literal) || !append(out, size, &length, " + ")) {
+            break;
+        }
+    }
+    out[length] = '\0';
+}
+
+/* deeply indented code, mostly whitespace */
+static void generate_whitespace(char *out, size_t size) {
+    unsigned int seed = 4;
+    size_t length = 0;
+    char indent[72];
+
+    for (;;) {
+        unsigned int n = 8 + next_random(&seed) % 64;
+        memset(indent, ' ', n);
+        indent[n] = '\0';
+
+        if (!append(out, size, &length, indent) || !append(out, size, &length, "x = x + 1\n")) {
+            break;
+        }
+    }
+    out[length] = '\0';
+}
+
+static double now_seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* takes the best of BENCH_REPEATS runs. tokens go to an arena which is reset
+ * between runs, so after the first run the timing is the lexer alone */
+static void bench(const Workload *workload, char *source, size_t size) {
+    Arena arena;
+    init_arena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+
+    workload->generate(source, size);
+    size_t length = strlen(source);
+    unsigned int tokens = 0;
+    double best = 0;
+
+    for (unsigned int i = 0; i < BENCH_REPEATS + 1; i++) {
+        double start = now_seconds();
+        TokenArray *array = tokenize_in(&arena, source);
+        double elapsed = now_seconds() - start;
+
+        tokens = array->count;
+        reset_arena(&arena);
+        if (i > 0 && (best == 0 || elapsed < best)) {
+            best = elapsed;
+        }
+    }
+
+    printf("%-12s %-40s %8.1f MB/s  %8.1f Mtokens/s  (%u tokens)\n", workload->name,
+            workload->description, length / best / 1e6, tokens / best / 1e6, tokens);
+    free_arena(&arena);
+}
+
+int main(int argc, char *argv[]) {
+    static const Workload workloads[] = {
+        { "code", "indented statements, short names", generate_code },
+        { "identifiers", "long identifiers and operators", generate_identifiers },
+        { "strings", "string literals", generate_strings },
+        { "whitespace", "deep indentation", generate_whitespace },
+    };
+    size_t size_mb = 16;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--size-mb=", 10) == 0) {
+            size_mb = strtoul(argv[i] + 10, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--size-mb=N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t size = size_mb * 1024 * 1024;
+    char *source = malloc(size);
+
+    for (unsigned int i = 0; i < sizeof workloads / sizeof *workloads; i++) {
+        bench(&workloads[i], source, size);
+    }
+
+    free(source);
+    return 0;
+}
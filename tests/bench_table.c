@@ -0,0 +1,242 @@
+/* Hash table microbenchmark: times insert, hit lookup, miss lookup, delete
+ * and delete/insert churn on tables of 8 up to 10M keys, for short, long and
+ * mixed length keys. Each result is one line of CSV (or JSON with --json)
+ * giving ns/op, the probe lengths of the filled table and the peak RSS so far.
+ *
+ * run with `make bench-table`, or
+ *     ./bench_table [--json] [--max-keys=N]
+ * to compare against another build, diff the output of both */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "table.h"
+
+#define BENCH_MAX_KEYS 10000000u
+/* small tables are rebuilt and measured repeatedly until this many ops */
+#define BENCH_MIN_OPS 1000000u
+/* miss lookups and churn draw from at most this many fresh keys */
+#define BENCH_MISS_KEYS 1000000u
+#define BENCH_HISTOGRAM 64
+
+/* a prime, so i * BENCH_STRIDE % n visits every key once in scattered order */
+#define BENCH_STRIDE 2654435761ull
+
+typedef struct {
+    const char *name;
+    unsigned int min_length;
+    unsigned int max_length;
+} KeyDistribution;
+
+static const unsigned int sizes[] = { 8, 64, 1000, 10000, 100000, 1000000, 10000000 };
+
+static const KeyDistribution distributions[] = {
+    { "short", 8, 8 },
+    { "long", 64, 64 },
+    { "mixed", 8, 64 },
+};
+
+typedef struct {
+    char **keys;
+    char *chars;
+} KeySet;
+
+static int json = 0;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/* makes count unique keys: prefix, the key's number in base 62, then random
+ * letters up to a length drawn from dist */
+static KeySet make_keys(unsigned int count, const KeyDistribution *dist, char prefix) {
+    static const char digits[] =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    KeySet set;
+    set.keys = malloc(count * sizeof *set.keys);
+    set.chars = malloc((size_t)count * (dist->max_length + 1));
+
+    char *p = set.chars;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int length = dist->min_length
+            + next_random() % (dist->max_length - dist->min_length + 1);
+
+        set.keys[i] = p;
+        p[0] = prefix;
+        unsigned int n = i;
+        for (unsigned int j = 1; j < 6; j++) {
+            p[j] = digits[n % 62];
+            n /= 62;
+        }
+        for (unsigned int j = 6; j < length; j++) {
+            p[j] = 'a' + next_random() % 26;
+        }
+        p[length] = '\0';
+        p += length + 1;
+    }
+
+    return set;
+}
+
+static void free_keys(KeySet *set) {
+    free(set->keys);
+    free(set->chars);
+}
+
+static HashTable *fill_table(KeySet *set, unsigned int n) {
+    HashTable *table = init_table();
+    for (unsigned int i = 0; i < n; i++) {
+        add_entry(table, set->keys[i], int_value(i));
+    }
+    return table;
+}
+
+static inline unsigned int scattered(unsigned long i, unsigned int n) {
+    return i * BENCH_STRIDE % n;
+}
+
+static void report(const char *workload, const KeyDistribution *dist, unsigned int n,
+        unsigned long ops, double elapsed, HashTable *table) {
+    unsigned int histogram[BENCH_HISTOGRAM];
+    table_probe_histogram(table, histogram, BENCH_HISTOGRAM);
+
+    unsigned long total = 0;
+    unsigned long counted = 0;
+    for (unsigned int i = 0; i < BENCH_HISTOGRAM; i++) {
+        total += (unsigned long)i * histogram[i];
+        counted += histogram[i];
+    }
+    double mean_probe = counted > 0 ? (double)total / counted : 0;
+    double ns_per_op = elapsed * 1e9 / ops;
+
+    if (json) {
+        printf("{\"workload\": \"%s\", \"keys\": %u, \"key_length\": \"%s\", "
+                "\"ops\": %lu, \"ns_per_op\": %.2f, \"mean_probe\": %.3f, "
+                "\"max_probe\": %u, \"capacity\": %u, \"peak_rss_kb\": %ld}\n",
+                workload, n, dist->name, ops, ns_per_op, mean_probe, table->max_probe,
+                table->capacity, peak_rss_kb());
+    } else {
+        printf("%s,%u,%s,%lu,%.2f,%.3f,%u,%u,%ld\n", workload, n, dist->name, ops, ns_per_op,
+                mean_probe, table->max_probe, table->capacity, peak_rss_kb());
+    }
+    fflush(stdout);
+}
+
+static void bench_size(const KeyDistribution *dist, KeySet *hits, KeySet *misses, unsigned int n) {
+    unsigned int reps = n < BENCH_MIN_OPS ? BENCH_MIN_OPS / n : 1;
+    unsigned int fresh = n < BENCH_MISS_KEYS ? n : BENCH_MISS_KEYS;
+    unsigned long ops = (unsigned long)reps * n;
+    unsigned long found = 0;
+    double elapsed = 0;
+
+    /* insert: a fresh table each rep, including its growth */
+    HashTable *table = NULL;
+    for (unsigned int r = 0; r < reps; r++) {
+        if (table != NULL) {
+            free_table(table);
+        }
+        double start = now_seconds();
+        table = fill_table(hits, n);
+        elapsed += now_seconds() - start;
+    }
+    report("insert", dist, n, ops, elapsed, table);
+
+    double start = now_seconds();
+    for (unsigned long i = 0; i < ops; i++) {
+        found += get_entry(table, hits->keys[scattered(i, n)]) != NULL;
+    }
+    report("hit", dist, n, ops, now_seconds() - start, table);
+
+    unsigned long miss_ops = (unsigned long)reps * fresh;
+    start = now_seconds();
+    for (unsigned long i = 0; i < miss_ops; i++) {
+        found += get_entry(table, misses->keys[scattered(i, fresh)]) != NULL;
+    }
+    report("miss", dist, n, miss_ops, now_seconds() - start, table);
+
+    /* churn: delete the oldest key and add a fresh one, keeping n keys. odd
+     * reps swap the fresh keys back out for the originals */
+    start = now_seconds();
+    for (unsigned int r = 0; r < reps; r++) {
+        KeySet *out = r % 2 == 0 ? hits : misses;
+        KeySet *in = r % 2 == 0 ? misses : hits;
+        for (unsigned int i = 0; i < fresh; i++) {
+            del_entry(table, out->keys[i]);
+            add_entry(table, in->keys[i], int_value(i));
+        }
+    }
+    report("churn", dist, n, 2 * miss_ops, now_seconds() - start, table);
+    free_table(table);
+
+    /* delete: every key, shrinking the table back down */
+    elapsed = 0;
+    for (unsigned int r = 0; r < reps; r++) {
+        table = fill_table(hits, n);
+        start = now_seconds();
+        for (unsigned int i = 0; i < n; i++) {
+            del_entry(table, hits->keys[scattered(i, n)]);
+        }
+        elapsed += now_seconds() - start;
+        if (r + 1 < reps) {
+            free_table(table);
+        }
+    }
+    report("delete", dist, n, ops, elapsed, table);
+    free_table(table);
+
+    if (found != ops) {
+        fprintf(stderr, "bench_table: found %lu of %lu keys\n", found, ops);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int max_keys = BENCH_MAX_KEYS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strncmp(argv[i], "--max-keys=", 11) == 0) {
+            max_keys = strtoul(argv[i] + 11, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--max-keys=N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!json) {
+        printf("workload,keys,key_length,ops,ns_per_op,mean_probe,max_probe,capacity,peak_rss_kb\n");
+    }
+
+    for (unsigned int d = 0; d < sizeof distributions / sizeof *distributions; d++) {
+        const KeyDistribution *dist = &distributions[d];
+        KeySet hits = make_keys(max_keys, dist, 'h');
+        KeySet misses = make_keys(max_keys < BENCH_MISS_KEYS ? max_keys : BENCH_MISS_KEYS, dist, 'm');
+
+        for (unsigned int i = 0; i < sizeof sizes / sizeof *sizes && sizes[i] <= max_keys; i++) {
+            bench_size(dist, &hits, &misses, sizes[i]);
+        }
+
+        free_keys(&hits);
+        free_keys(&misses);
+    }
+
+    return 0;
+}
@@ -4,7 +4,10 @@
 
 #include "test.h"
 #include "test_table.h"
+#include "test_shared_table.h"
+#include "test_arena.h"
 #include "test_component.h"
+#include "test_value.h"
 
 /* writing tests:
  *
@@ -34,6 +37,23 @@ int main() {
     TEST(test_ht_add_entry, "Adding 3 entries to a hash table and then retrieving them");
     TEST(test_ht_resize, "Adding 8 entries to a hash table to force a resize and then retrieving them");
     TEST(test_ht_stress, "Add 2000 entries, delete 2000 entries, add 2000 new entries");
+    TEST(test_ht_probe_lengths, "Probe lengths stay short after adding and deleting entries");
+    TEST(test_ht_upsert, "Upserting keys adds each once and updates it in place after that");
+    TEST(test_ht_insertion_order, "Entries are stored densely and iterated in insertion order");
+    TEST(test_ht_compact, "Compacting a table after bulk deletes shrinks it to fit its entries");
+    TEST(test_hash_bytes, "Key hashes depend on every byte of the key and on the seed");
+    TEST(test_shared_table, "Threads read a shared table while others add and replace its values");
+    TEST(test_arena, "Arena allocations are aligned, grow in place and are reused after a reset");
+    TEST(test_value_encoding, "Values of every type round-trip through their constructors and accessors");
     TEST(test_motmot_arithmetic, "Source strings compile to expected bytecode and evaluate to expected result");
+    TEST(test_motmot_tokens, "Tokens refer to their text in the source and end where their characters do");
+    TEST(test_motmot_streaming, "The parser pulls tokens from a lexer as it compiles, without a token array");
+    TEST(test_motmot_stack_depth, "The compiler computes each chunk's stack depth and the stack grows to fit it");
+    TEST(test_motmot_globals, "Global variables are defined, redefined and read through their slots");
+    TEST(test_motmot_symbols, "Identifiers and string literals are interned in the VM's symbol table");
+    TEST(test_motmot_shared_globals, "VMs attached to a shared scope read its globals behind their own");
+    TEST(test_motmot_quickening, "Arithmetic opcodes are specialized to their operand types and deoptimized on mismatch");
+    TEST(test_motmot_superinstructions, "Common opcode pairs are fused into superinstructions");
+    TEST(test_motmot_register, "Source strings compile to register code which evaluates to expected result");
 }
 
@@ -0,0 +1,144 @@
+#ifndef _TEST_ARENA_H_
+#define _TEST_ARENA_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+#include "arena.h"
+#include "bytecode.h"
+#include "parser.h"
+#include "tokenize.h"
+#include "vm.h"
+
+int test_arena() {
+    INIT_TEST();
+
+    Arena arena;
+    init_arena(&arena, 64);
+
+    BEGIN_TEST_CASE("Allocations are aligned and don't overlap across blocks");
+    unsigned char *previous = NULL;
+    for (unsigned int i = 1; i <= 100; i++) {
+        unsigned char *p = arena_alloc(&arena, i);
+        if ((uintptr_t)p % ARENA_ALIGNMENT != 0) {
+            TEST_FAIL();
+            break;
+        }
+        memset(p, i, i);
+        if (previous != NULL && previous[0] != i - 1) {
+            TEST_FAIL();
+            break;
+        }
+        previous = p;
+    }
+    if (arena.blocks == NULL || arena.blocks->next == NULL) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Resetting merges the blocks into one which later use fits in");
+    size_t usage = arena_memory_usage(&arena);
+    reset_arena(&arena);
+    if (arena.blocks == NULL || arena.blocks->next != NULL || arena_memory_usage(&arena) > usage) {
+        TEST_FAIL();
+    }
+    for (unsigned int i = 1; i <= 100; i++) {
+        arena_alloc(&arena, i);
+    }
+    if (arena.blocks->next != NULL) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("The latest allocation grows in place, others are copied");
+    reset_arena(&arena);
+    char *first = arena_alloc(&arena, 8);
+    memcpy(first, "abcdefg", 8);
+    char *grown = arena_realloc(&arena, first, 8, 32);
+    char *other = arena_alloc(&arena, 8);
+    char *moved = arena_realloc(&arena, grown, 32, 64);
+    if (grown != first || moved == grown || moved == other || strcmp(moved, "abcdefg") != 0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    free_arena(&arena);
+
+    BEGIN_TEST_CASE("A NULL arena allocates from the heap");
+    char *heap = arena_alloc(NULL, 4);
+    memcpy(heap, "abc", 4);
+    heap = arena_realloc(NULL, heap, 4, 4096);
+    if (strcmp(heap, "abc") != 0) {
+        TEST_FAIL();
+    }
+    arena_free(NULL, heap);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Code compiled into the compile arena runs and the arena stops growing");
+    VirtualMachine vm = initialize_vm();
+    /* enough operands to grow the token and bytecode arrays and the constants */
+    char source[4096] = "0";
+    for (unsigned int i = 1; i <= 200; i++) {
+        snprintf(source + strlen(source), sizeof source - strlen(source), " + %u", i);
+    }
+
+    size_t first_usage = 0;
+    for (unsigned int run = 0; run < 10; run++) {
+        TokenArray *tokens = tokenize_in(&vm.compile_arena, source);
+        BytecodeArray *chunk = parse(&vm, tokens);
+        if (chunk->arena != &vm.compile_arena) {
+            TEST_FAIL();
+        }
+
+        evaluate(&vm, chunk);
+        Value v = pop(&vm.stack);
+        if (!IS_INTEGER(v) || AS_INTEGER(v) != 200 * 201 / 2) {
+            TEST_FAIL();
+            break;
+        }
+
+        free_array(tokens);
+        free_bytecode_dynarray(chunk);
+        reset_arena(&vm.compile_arena);
+
+        if (run == 0) {
+            first_usage = arena_memory_usage(&vm.compile_arena);
+        } else if (arena_memory_usage(&vm.compile_arena) != first_usage
+                || vm.compile_arena.blocks->next != NULL) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Code with more constants or names than a chunk holds is rejected");
+    VirtualMachine vm = initialize_vm();
+    char source[8192] = "0";
+    for (unsigned int i = 1; i <= MAX_CHUNK_CONSTANTS; i++) {
+        snprintf(source + strlen(source), sizeof source - strlen(source), " + %u", i);
+    }
+    if (parse_source(&vm, source, &vm.compile_arena) != NULL) {
+        TEST_FAIL();
+    }
+    reset_arena(&vm.compile_arena);
+
+    strcpy(source, "x0");
+    for (unsigned int i = 1; i <= MAX_CHUNK_NAMES; i++) {
+        snprintf(source + strlen(source), sizeof source - strlen(source), " + x%u", i);
+    }
+    if (parse_source(&vm, source, &vm.compile_arena) != NULL
+            || vm.names.elements != MAX_CHUNK_NAMES) {
+        TEST_FAIL();
+    }
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
+#endif /* _TEST_ARENA_H_ */
@@ -4,13 +4,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "test.h"
 
+#include "arith.h"
 #include "common.h"
+#include "hash.h"
 #include "bytecode.h"
 #include "tokenize.h"
+#include "optimize.h"
 #include "parser.h"
+#include "register_vm.h"
 #include "vm.h"
 #include "table.h"
 
@@ -44,7 +49,7 @@ int test_motmot_arithmetic() {
 
     evaluate(&vm, chunk);
 
-    if (pop(&vm.stack).as.real != 4.0) {
+    if (AS_INTEGER(pop(&vm.stack)) != 4) {
         TEST_FAIL();
     }
 
@@ -61,7 +66,7 @@ int test_motmot_arithmetic() {
 
     evaluate(&vm, chunk);
 
-    if (pop(&vm.stack).as.real != 7.0) {
+    if (AS_INTEGER(pop(&vm.stack)) != 7) {
         TEST_FAIL();
     }
 
@@ -78,7 +83,7 @@ int test_motmot_arithmetic() {
 
     evaluate(&vm, chunk);
 
-    if (pop(&vm.stack).as.real != 5.0) {
+    if (AS_INTEGER(pop(&vm.stack)) != 5) {
         TEST_FAIL();
     }
 
@@ -86,6 +91,781 @@ int test_motmot_arithmetic() {
     free_bytecode_dynarray(chunk);
     free_vm(&vm);
     END_TEST_CASE();
+
+    BEGIN_TEST_CASE("1 + 2.5 mixes an integer and a double into 3.5");
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("1 + 2.5");
+    BytecodeArray *chunk = parse(&vm, tokens);
+
+    if (!IS_INTEGER(chunk->constants->array[0]) || !IS_DOUBLE(chunk->constants->array[1])) {
+        TEST_FAIL();
+    }
+
+    evaluate(&vm, chunk);
+    Value v = pop(&vm.stack);
+    if (!IS_DOUBLE(v) || AS_DOUBLE(v) != 3.5) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Integer division is exact or promoted to a double");
+    Value v;
+    if (!arith_div(int_value(6), int_value(3), &v) || !IS_INTEGER(v) || AS_INTEGER(v) != 2) {
+        TEST_FAIL();
+    }
+    if (!arith_div(int_value(7), int_value(2), &v) || !IS_DOUBLE(v) || AS_DOUBLE(v) != 3.5) {
+        TEST_FAIL();
+    }
+    if (!arith_div(int_value(6), int_value(-1), &v) || !IS_INTEGER(v) || AS_INTEGER(v) != -6) {
+        TEST_FAIL();
+    }
+    if (!arith_div(int_value(VALUE_INT_MIN), int_value(-1), &v)
+            || !IS_DOUBLE(v) || AS_DOUBLE(v) != -(double)VALUE_INT_MIN) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Integer overflow is promoted to a double");
+    Value v;
+    if (!arith_add(int_value(VALUE_INT_MAX), int_value(1), &v)
+            || !IS_DOUBLE(v) || AS_DOUBLE(v) != (double)VALUE_INT_MAX + 1.0) {
+        TEST_FAIL();
+    }
+    if (!arith_mult(int_value(VALUE_INT_MIN), int_value(2), &v)
+            || !IS_DOUBLE(v) || AS_DOUBLE(v) != (double)VALUE_INT_MIN * 2.0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+    END_TEST();
+}
+
+int test_motmot_tokens() {
+    INIT_TEST();
+
+    BEGIN_TEST_CASE("Tokens are slices of the source");
+    const char *source = "var name = 'a b' + 12.5";
+    TokenArray *tokens = tokenize(source);
+    Token *t = tokens->tokens;
+    if (tokens->count != 7
+            || t[1].type != T_IDENTIFIER || t[1].offset != 4 || t[1].length != 4
+            || token_text(tokens, &t[1]) != source + 4
+            || t[3].type != T_STRING || t[3].length != 3
+            || strncmp(token_text(tokens, &t[3]), "a b", 3) != 0
+            || t[5].type != T_NUMBER || strncmp(token_text(tokens, &t[5]), "12.5", t[5].length) != 0
+            || t[6].type != T_EOF) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("An unterminated string stops at the end of the source");
+    TokenArray *tokens = tokenize("\"abc");
+    if (tokens->count != 2 || tokens->tokens[0].type != T_ERROR
+            || tokens->tokens[0].length != 3) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Number literals are parsed from their own text only");
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("var e5 = 2 1e5");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    evaluate(&vm, chunk);
+    if (vm.stack.head != 0 || AS_INTEGER(*get_global(&vm, "e5")) != 2) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Runs of every length are scanned to their exact end, in and out of vectors");
+    char run[256];
+    for (unsigned int n = 1; n <= 70; n++) {
+        /* identifier, then whitespace, then a number ending the source */
+        memset(run, 'a', n);
+        if (n > 1) {
+            run[n - 1] = n % 2 ? '_' : '7';
+        }
+        memset(run + n, ' ', n);
+        memset(run + 2 * n, '3', n);
+        if (n > 1) {
+            run[2 * n + n / 2] = '.';
+        }
+        run[3 * n] = '\0';
+
+        TokenArray *tokens = tokenize(run);
+        Token *t = tokens->tokens;
+        if (tokens->count != 3
+                || t[0].type != T_IDENTIFIER || t[0].offset != 0 || t[0].length != n
+                || t[1].type != (n > 1 ? T_NUMBER : T_INTEGER) || t[1].offset != 2 * n
+                || t[1].length != n) {
+            TEST_FAIL();
+        }
+        free_array(tokens);
+
+        /* a string holding the other quote, and whitespace ending the source */
+        run[0] = '\'';
+        memset(run + 1, '"', n);
+        run[n + 1] = '\'';
+        memset(run + n + 2, '\t', n);
+        run[2 * n + 2] = '\0';
+
+        tokens = tokenize(run);
+        t = tokens->tokens;
+        if (tokens->count != 2 || t[0].type != T_STRING || t[0].offset != 1 || t[0].length != n
+                || t[1].type != T_EOF) {
+            TEST_FAIL();
+        }
+        free_array(tokens);
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Every keyword is recognized and words close to one are identifiers");
+    /* true and false are boolean tokens, the rest have their own type */
+    const char *keywords[] = { "nil", "and", "or", "fun", "if", "else", "for", "while", "var",
+        "true", "false" };
+    TokenType keyword_types[] = { T_NIL, T_AND, T_OR, T_FUN, T_IF, T_ELSE, T_FOR, T_WHILE, T_VAR,
+        T_BOOLEAN, T_BOOLEAN };
+    unsigned int keyword_count = sizeof keywords / sizeof *keywords;
+    if (keyword_count != T_FALSE - T_AND + 2) {
+        TEST_FAIL();
+    }
+    for (unsigned int i = 0; i < keyword_count; i++) {
+        TokenArray *tokens = tokenize(keywords[i]);
+        if (tokens->tokens[0].type != keyword_types[i]) {
+            TEST_FAIL();
+        }
+        free_array(tokens);
+    }
+
+    const char *near_misses[] = { "a", "an", "andd", "nul", "nl", "fn", "fur", "fals", "falsee",
+        "iff", "If", "wile", "whale", "vr", "tru", "ore", "or_", "else1", "x" };
+    for (unsigned int i = 0; i < sizeof near_misses / sizeof *near_misses; i++) {
+        TokenArray *tokens = tokenize(near_misses[i]);
+        if (tokens->tokens[0].type != T_IDENTIFIER) {
+            TEST_FAIL();
+        }
+        free_array(tokens);
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Bytes outside ascii end an identifier and are skipped");
+    TokenArray *tokens = tokenize("caf\xc3\xa9 x");
+    if (tokens->count != 3 || tokens->tokens[0].length != 3
+            || tokens->tokens[1].type != T_IDENTIFIER || tokens->tokens[1].offset != 6) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
+int test_motmot_streaming() {
+    INIT_TEST();
+
+    BEGIN_TEST_CASE("A lexer hands out the same tokens as tokenize(), then T_EOF for good");
+    const char *source = "var total = (count + 1.5) * \"s\" == x";
+    TokenArray *tokens = tokenize(source);
+    Lexer lexer;
+    init_lexer(&lexer, source);
+    for (unsigned int i = 0; i < tokens->count + 2; i++) {
+        Token expected = tokens->tokens[i < tokens->count ? i : tokens->count - 1];
+        Token t = lex_token(&lexer);
+        if (t.type != expected.type || t.offset != expected.offset || t.length != expected.length) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    free_array(tokens);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Compiling while lexing emits the same code as compiling a token array");
+    VirtualMachine vm = initialize_vm();
+    const char *sources[] = { "var x = 3", "var y = (x + 1) * (x - 1)", "y / -x + \"a\" == 2",
+        "1 + 2 * 3 - 4 / 5" };
+    for (unsigned int i = 0; i < sizeof sources / sizeof *sources; i++) {
+        TokenArray *tokens = tokenize(sources[i]);
+        BytecodeArray *expected = parse(&vm, tokens);
+        BytecodeArray *chunk = parse_source(&vm, sources[i], NULL);
+        if (chunk->elements != expected->elements || chunk->max_stack != expected->max_stack
+                || memcmp(chunk->array, expected->array, chunk->elements) != 0
+                || chunk->constants->elements != expected->constants->elements) {
+            TEST_FAIL();
+        }
+
+        RegisterCode *expected_code = parse_register(&vm, tokens);
+        RegisterCode *code = parse_register_source(&vm, sources[i]);
+        if (code->elements != expected_code->elements
+                || memcmp(code->array, expected_code->array, code->elements * sizeof *code->array) != 0) {
+            TEST_FAIL();
+        }
+
+        evaluate(&vm, chunk);
+        free_array(tokens);
+        free_bytecode_dynarray(expected);
+        free_bytecode_dynarray(chunk);
+        free_register_code(expected_code);
+        free_register_code(code);
+    }
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("A long expression compiles without memory for its tokens");
+    VirtualMachine vm = initialize_vm();
+    BytecodeArray *chunk = parse_source(&vm, "var x = 1", NULL);
+    evaluate(&vm, chunk);
+    free_bytecode_dynarray(chunk);
+
+    unsigned int terms = 50000;
+    char *long_source = malloc(terms * 4);
+    strcpy(long_source, "x");
+    for (unsigned int i = 1; i < terms; i++) {
+        memcpy(long_source + 4 * i - 3, " + x", 5);
+    }
+
+    chunk = parse_source(&vm, long_source, &vm.compile_arena);
+    size_t used = arena_memory_usage(&vm.compile_arena);
+    evaluate(&vm, chunk);
+    Value v = pop(&vm.stack);
+    if (!IS_INTEGER(v) || AS_INTEGER(v) != terms
+            || used >= (2 * terms - 1) * sizeof(Token)) {
+        TEST_FAIL();
+    }
+    reset_arena(&vm.compile_arena);
+    free(long_source);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("An unterminated string is reported once and not compiled");
+    VirtualMachine vm = initialize_vm();
+    /* report_error() writes to stderr, capture it to count the errors */
+    FILE *errors = tmpfile();
+    int saved_stderr = dup(STDERR_FILENO);
+    fflush(stderr);
+    dup2(fileno(errors), STDERR_FILENO);
+
+    BytecodeArray *chunk = parse_source(&vm, "1 + \"abc", NULL);
+    RegisterCode *code = parse_register_source(&vm, "\"abc");
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+
+    char message[128];
+    unsigned int unterminated = 0, reported = 0;
+    rewind(errors);
+    while (fgets(message, sizeof message, errors) != NULL) {
+        reported++;
+        unterminated += strstr(message, "Unterminated string literal") != NULL;
+    }
+    fclose(errors);
+
+    if (chunk != NULL || code != NULL || unterminated != 2 || reported != 2) {
+        TEST_FAIL();
+    }
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
+int test_motmot_stack_depth() {
+    INIT_TEST();
+
+    BEGIN_TEST_CASE("1 + 2 * 3 needs three stack slots");
+    VirtualMachine vm = initialize_vm();
+    if (vm.stack.size != STACK_INITIAL_SIZE) {
+        TEST_FAIL();
+    }
+
+    TokenArray *tokens = tokenize("1 + 2 * 3");
+    BytecodeArray *chunk = parse(&vm, tokens);
+
+    if (chunk->max_stack != 3) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("-3 negates without touching the rest of the stack");
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("2 - -3");
+    BytecodeArray *chunk = parse(&vm, tokens);
+
+    evaluate(&vm, chunk);
+    if (chunk->max_stack != 2 || vm.stack.head != 1
+            || AS_INTEGER(pop(&vm.stack)) != 5) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Expressions deeper than the stack grow it instead of wrapping");
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("var x = 1");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    evaluate(&vm, chunk);
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+
+    /* x + (x + (... x)), using a global since constants are limited */
+    unsigned int depth = 2000;
+    char *code = malloc(depth * 6 + 2);
+    char *c = code;
+    for (unsigned int i = 0; i < depth; i++) {
+        c += sprintf(c, "x + (");
+    }
+    c += sprintf(c, "x");
+    for (unsigned int i = 0; i < depth; i++) {
+        *c++ = ')';
+    }
+    *c = '\0';
+
+    tokens = tokenize(code);
+    chunk = parse(&vm, tokens);
+
+    evaluate(&vm, chunk);
+    if (chunk->max_stack != depth + 1 || vm.stack.size < depth + 1
+            || vm.stack.head != 1 || AS_INTEGER(pop(&vm.stack)) != depth + 1) {
+        TEST_FAIL();
+    }
+
+    shrink_stack(&vm.stack);
+    if (vm.stack.size != STACK_INITIAL_SIZE) {
+        TEST_FAIL();
+    }
+
+    free(code);
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("An operator missing its operands is rejected instead of run");
+    VirtualMachine vm = initialize_vm();
+    const char *sources[] = { "(+) + 1", "1 + * 2", "-" };
+    for (unsigned int i = 0; i < sizeof sources / sizeof *sources; i++) {
+        if (parse_source(&vm, sources[i], NULL) != NULL) {
+            TEST_FAIL();
+        }
+    }
+    if (vm.stack.head != 0) {
+        TEST_FAIL();
+    }
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
+int test_motmot_globals() {
+    INIT_TEST();
+
+    VirtualMachine vm = initialize_vm();
+    char *sources[] = { "var x = 3", "var y = x * 2", "var x = y + x", "x" };
+    BytecodeArray *chunks[4];
+
+    for (unsigned int i = 0; i < 4; i++) {
+        TokenArray *tokens = tokenize(sources[i]);
+        chunks[i] = parse(&vm, tokens);
+        free_array(tokens);
+        evaluate(&vm, chunks[i]);
+    }
+
+    BEGIN_TEST_CASE("Globals are stored in slots indexed by their name");
+    if (vm.globals->elements != 2
+            || AS_INTEGER(vm.globals->array[0]) != 9
+            || AS_INTEGER(vm.globals->array[1]) != 6) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Redefining a global doesn't add another env entry");
+    if (vm.env->elements != 2) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Reading a global after redefinition sees the new value");
+    if (vm.stack.head != 1 || AS_INTEGER(pop(&vm.stack)) != 9) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("get_global finds defined globals through env");
+    Value *x = get_global(&vm, vm.names.array[0]);
+    if (x == NULL || x != &vm.globals->array[0]) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("compact_vm keeps globals and reports no more memory than before");
+    VMMemory before;
+    VMMemory after;
+    vm_memory_usage(&vm, &before);
+    compact_vm(&vm);
+    vm_memory_usage(&vm, &after);
+    if (before.env == 0 || before.symbols == 0 || after.env > before.env
+            || after.symbols > before.symbols || get_global(&vm, "y") != &vm.globals->array[1]) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Reading an undefined global leaves the stack untouched");
+    TokenArray *tokens = tokenize("z + 1");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    evaluate(&vm, chunk);
+    if (vm.stack.head != 0) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("A type error unwinds the values pushed before it");
+    TokenArray *tokens = tokenize("x + x * \"a\"");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    evaluate(&vm, chunk);
+    if (vm.stack.head != 0) {
+        TEST_FAIL();
+    }
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    END_TEST_CASE();
+
+    for (unsigned int i = 0; i < 4; i++) {
+        free_bytecode_dynarray(chunks[i]);
+    }
+    free_vm(&vm);
+
+    END_TEST();
+}
+
+int test_motmot_symbols() {
+    INIT_TEST();
+
+    VirtualMachine vm = initialize_vm();
+    char *sources[] = { "var abc = \"str\"", "abc", "\"str\"" };
+    BytecodeArray *chunks[3];
+
+    for (unsigned int i = 0; i < 3; i++) {
+        TokenArray *tokens = tokenize(sources[i]);
+        chunks[i] = parse(&vm, tokens);
+        free_array(tokens);
+    }
+
+    BEGIN_TEST_CASE("A name used across chunks is added to names once");
+    if (vm.names.elements != 1 || strcmp(vm.names.array[0], "abc") != 0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Names point at the interned symbol and keep its hash and length");
+    Entry *symbol = intern_entry(vm.symbols, "abc", 3);
+    if (symbol->key != vm.names.array[0] || AS_INTEGER(symbol->value) != 0
+            || vm.names.keys[0].hash != hash_bytes("abc", 3) || vm.names.keys[0].length != 3) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Equal string literals share one interned string");
+    char *first = AS_STRING(chunks[0]->constants->array[0]);
+    char *second = AS_STRING(chunks[2]->constants->array[0]);
+    if (first != second || first != intern_entry(vm.symbols, "str", 3)->key) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Interning doesn't depend on the key being NUL-terminated");
+    if (intern_entry(vm.symbols, "abcdef", 3) != intern_entry(vm.symbols, "abc", 3)
+            || vm.symbols->elements != 2) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    for (unsigned int i = 0; i < 3; i++) {
+        free_bytecode_dynarray(chunks[i]);
+    }
+    free_vm(&vm);
+
+    END_TEST();
+}
+
+int test_motmot_shared_globals() {
+    INIT_TEST();
+
+    SharedTable *shared = init_shared_table();
+    shared_table_set(shared, "limit", int_value(10));
+
+    VirtualMachine first = initialize_vm();
+    VirtualMachine second = initialize_vm();
+    attach_shared_globals(&first, shared);
+    attach_shared_globals(&second, shared);
+
+    char *sources[] = { "limit * 2", "limit + limit", "var limit = 1", "limit", "other" };
+    BytecodeArray *chunks[5];
+    for (unsigned int i = 0; i < 5; i++) {
+        TokenArray *tokens = tokenize(sources[i]);
+        chunks[i] = parse(i < 2 ? &first : &second, tokens);
+        free_array(tokens);
+    }
+
+    BEGIN_TEST_CASE("A VM reads globals it hasn't defined from the shared scope");
+    evaluate(&first, chunks[0]);
+    if (first.stack.head != 1 || AS_INTEGER(pop(&first.stack)) != 20) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Fused global reads see values stored in the shared scope later");
+    shared_table_set(shared, "limit", int_value(7));
+    fuse_superinstructions(chunks[1]);
+    evaluate(&first, chunks[1]);
+    if (chunks[1]->array[0] != OP_GET_GLOBAL2
+            || first.stack.head != 1 || AS_INTEGER(pop(&first.stack)) != 14) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("A VM's own definition shadows the shared one for that VM only");
+    evaluate(&second, chunks[2]);
+    evaluate(&second, chunks[3]);
+    Value limit;
+    if (second.stack.head != 1 || AS_INTEGER(pop(&second.stack)) != 1
+            || !shared_table_get(shared, "limit", &limit) || AS_INTEGER(limit) != 7) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Names in neither scope are still reported as not found");
+    evaluate(&second, chunks[4]);
+    if (second.stack.head != 0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    for (unsigned int i = 0; i < 5; i++) {
+        free_bytecode_dynarray(chunks[i]);
+    }
+    free_vm(&first);
+    free_vm(&second);
+    free_shared_table(shared);
+
+    END_TEST();
+}
+
+int test_motmot_quickening() {
+    INIT_TEST();
+
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("2.0 + 2.0");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    free_array(tokens);
+
+    BEGIN_TEST_CASE("OP_ADD on two doubles is quickened to OP_ADD_DD");
+    evaluate(&vm, chunk);
+    pop(&vm.stack);
+    if (chunk->array[4] != OP_ADD_DD || vm.stats.quickened != 1) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("OP_ADD_DD on two integers is rewritten back to OP_ADD");
+    chunk->constants->array[0] = int_value(2);
+    chunk->constants->array[1] = int_value(3);
+    evaluate(&vm, chunk);
+    Value v = pop(&vm.stack);
+    if (chunk->array[4] != OP_ADD || vm.stats.deoptimized != 1
+            || !IS_INTEGER(v) || AS_INTEGER(v) != 5) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("OP_ADD is quickened again to OP_ADD_II");
+    evaluate(&vm, chunk);
+    pop(&vm.stack);
+    if (chunk->array[4] != OP_ADD_II || vm.stats.quickened != 2) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    free_bytecode_dynarray(chunk);
+    free_vm(&vm);
+
+    END_TEST();
+}
+
+int test_motmot_superinstructions() {
+    INIT_TEST();
+
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("var x = 3");
+    BytecodeArray *chunk = parse(&vm, tokens);
+    evaluate(&vm, chunk);
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+
+    BEGIN_TEST_CASE("x * 2 + 1 fuses its constants into the arithmetic opcodes");
+    tokens = tokenize("x * 2 + 1");
+    chunk = parse(&vm, tokens);
+    fuse_superinstructions(chunk);
+
+    if (chunk->elements != 7
+            || chunk->array[0] != OP_GET_GLOBAL
+            || chunk->array[2] != OP_MULT_CONST
+            || chunk->array[4] != OP_ADD_CONST
+            || chunk->array[6] != OP_RETURN) {
+        TEST_FAIL();
+    }
+
+    evaluate(&vm, chunk);
+    if (AS_INTEGER(pop(&vm.stack)) != 7) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("x + x fuses both global reads into OP_GET_GLOBAL2");
+    tokens = tokenize("x + x");
+    chunk = parse(&vm, tokens);
+    fuse_superinstructions(chunk);
+
+    if (chunk->elements != 5
+            || chunk->array[0] != OP_GET_GLOBAL2
+            || chunk->array[3] != OP_ADD) {
+        TEST_FAIL();
+    }
+
+    evaluate(&vm, chunk);
+    if (AS_INTEGER(pop(&vm.stack)) != 6) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("x + 1 is quickened to OP_ADD_CONST_II and rewritten back when x changes type");
+    tokens = tokenize("x + 1");
+    chunk = parse(&vm, tokens);
+    fuse_superinstructions(chunk);
+    unsigned long quickened = vm.stats.quickened;
+    unsigned long deoptimized = vm.stats.deoptimized;
+
+    evaluate(&vm, chunk);
+    if (chunk->array[2] != OP_ADD_CONST_II || vm.stats.quickened != quickened + 1
+            || AS_INTEGER(pop(&vm.stack)) != 4) {
+        TEST_FAIL();
+    }
+
+    /* stays quickened while x is an integer */
+    evaluate(&vm, chunk);
+    if (chunk->array[2] != OP_ADD_CONST_II || AS_INTEGER(pop(&vm.stack)) != 4) {
+        TEST_FAIL();
+    }
+
+    *get_global(&vm, "x") = double_value(0.5);
+    evaluate(&vm, chunk);
+    Value v = pop(&vm.stack);
+    if (chunk->array[2] != OP_ADD_CONST || vm.stats.deoptimized != deoptimized + 1
+            || !IS_DOUBLE(v) || AS_DOUBLE(v) != 1.5) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_bytecode_dynarray(chunk);
+    END_TEST_CASE();
+
+    free_vm(&vm);
+
+    END_TEST();
+}
+
+int test_motmot_register() {
+    INIT_TEST();
+
+    BEGIN_TEST_CASE("2 + 2 compiles to a single three-address add");
+    VirtualMachine vm = initialize_vm();
+    TokenArray *tokens = tokenize("2 + 2");
+    RegisterCode *code = parse_register(&vm, tokens);
+
+    if (code->elements != 2
+            || REG_OP(code->array[0]) != ROP_ADD
+            || REG_A(code->array[0]) != 0
+            || REG_B(code->array[0]) != (RK_CONSTANT | 0)
+            || REG_C(code->array[0]) != (RK_CONSTANT | 1)
+            || REG_OP(code->array[1]) != ROP_RETURN
+            || code->registers != 1) {
+        TEST_FAIL();
+    }
+
+    evaluate_register(&vm, code);
+    if (vm.stack.head != 1 || AS_INTEGER(pop(&vm.stack)) != 4) {
+        TEST_FAIL();
+    }
+
+    free_array(tokens);
+    free_register_code(code);
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Globals and nested expressions evaluate like the stack VM");
+    VirtualMachine vm = initialize_vm();
+    char *sources[] = { "var x = 3", "var y = (x + 1) * (x - 1)", "y / -x" };
+    for (unsigned int i = 0; i < 3; i++) {
+        TokenArray *tokens = tokenize(sources[i]);
+        RegisterCode *code = parse_register(&vm, tokens);
+        evaluate_register(&vm, code);
+        free_array(tokens);
+        free_register_code(code);
+    }
+
+    Value *y = get_global(&vm, vm.names.array[1]);
+    if (y == NULL || AS_INTEGER(*y) != 8) {
+        TEST_FAIL();
+    }
+    if (vm.stack.head != 1 || AS_DOUBLE(pop(&vm.stack)) != -8.0 / 3.0) {
+        TEST_FAIL();
+    }
+
+    free_vm(&vm);
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("An expression needing more registers than an instruction can name is rejected");
+    VirtualMachine vm = initialize_vm();
+    /* x + (x + (x + ... )) keeps every x in its own register */
+    unsigned int depth = MAX_REGISTERS + 8;
+    char *source = malloc(depth * 6 + 2);
+    char *p = source;
+    for (unsigned int i = 0; i < depth; i++) {
+        p += sprintf(p, "x + (");
+    }
+    *p++ = 'x';
+    memset(p, ')', depth);
+    p[depth] = '\0';
+
+    if (parse_register_source(&vm, source) != NULL || vm.stack.head != 0) {
+        TEST_FAIL();
+    }
+    free(source);
+    free_vm(&vm);
+    END_TEST_CASE();
+
     END_TEST();
 }
 
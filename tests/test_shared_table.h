@@ -0,0 +1,128 @@
+#ifndef _TEST_SHARED_TABLE_H_
+#define _TEST_SHARED_TABLE_H_
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "shared_table.h"
+
+#define SHARED_TEST_KEYS 2000
+#define SHARED_TEST_WRITERS 2
+#define SHARED_TEST_READERS 4
+#define SHARED_TEST_ROUNDS 50
+
+typedef struct {
+    SharedTable *table;
+    char **keys;
+    unsigned int first;
+    int done;
+    unsigned long reads;
+    unsigned long bad_reads;
+} SharedTestThread;
+
+/* adds its share of the keys with value i, then keeps replacing them with
+ * values which are still i modulo SHARED_TEST_KEYS */
+static void *shared_test_writer(void *arg) {
+    SharedTestThread *t = arg;
+    unsigned int count = SHARED_TEST_KEYS / SHARED_TEST_WRITERS;
+
+    for (unsigned int round = 0; round < SHARED_TEST_ROUNDS; round++) {
+        for (unsigned int i = t->first; i < t->first + count; i++) {
+            shared_table_set(t->table, t->keys[i], int_value(i + round * SHARED_TEST_KEYS));
+        }
+    }
+    return NULL;
+}
+
+static void *shared_test_reader(void *arg) {
+    SharedTestThread *t = arg;
+    unsigned int i = t->first;
+
+    while (!__atomic_load_n(&t->done, __ATOMIC_ACQUIRE)) {
+        Value value;
+        i = (i * 1103515245 + 12345) % SHARED_TEST_KEYS;
+        if (shared_table_get(t->table, t->keys[i], &value)) {
+            if (!IS_INTEGER(value) || AS_INTEGER(value) % SHARED_TEST_KEYS != i) {
+                t->bad_reads++;
+            }
+        }
+        t->reads++;
+    }
+    return NULL;
+}
+
+int test_shared_table() {
+    INIT_TEST();
+
+    SharedTable *table = init_shared_table();
+    char *keys[SHARED_TEST_KEYS];
+    for (unsigned int i = 0; i < SHARED_TEST_KEYS; i++) {
+        keys[i] = malloc(sizeof(char) * 12);
+        snprintf(keys[i], 12, "global%d", i);
+    }
+
+    Value value;
+
+    BEGIN_TEST_CASE("Values set on one thread are read back, missing keys aren't found");
+    shared_table_set(table, "answer", int_value(41));
+    shared_table_set(table, "answer", int_value(42));
+    if (!shared_table_get(table, "answer", &value) || AS_INTEGER(value) != 42
+            || shared_table_get(table, "question", &value) || table->elements != 1) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    SharedTestThread writers[SHARED_TEST_WRITERS];
+    SharedTestThread readers[SHARED_TEST_READERS];
+    pthread_t writer_ids[SHARED_TEST_WRITERS];
+    pthread_t reader_ids[SHARED_TEST_READERS];
+
+    for (unsigned int i = 0; i < SHARED_TEST_READERS; i++) {
+        readers[i] = (SharedTestThread) { table, keys, i, 0, 0, 0 };
+        pthread_create(&reader_ids[i], NULL, shared_test_reader, &readers[i]);
+    }
+    for (unsigned int i = 0; i < SHARED_TEST_WRITERS; i++) {
+        writers[i] = (SharedTestThread) { table, keys, i * SHARED_TEST_KEYS / SHARED_TEST_WRITERS, 0, 0, 0 };
+        pthread_create(&writer_ids[i], NULL, shared_test_writer, &writers[i]);
+    }
+    for (unsigned int i = 0; i < SHARED_TEST_WRITERS; i++) {
+        pthread_join(writer_ids[i], NULL);
+    }
+    for (unsigned int i = 0; i < SHARED_TEST_READERS; i++) {
+        __atomic_store_n(&readers[i].done, 1, __ATOMIC_RELEASE);
+        pthread_join(reader_ids[i], NULL);
+    }
+
+    BEGIN_TEST_CASE("Readers only see whole values stored for the key they looked up");
+    for (unsigned int i = 0; i < SHARED_TEST_READERS; i++) {
+        if (readers[i].bad_reads != 0 || readers[i].reads == 0) {
+            TEST_FAIL();
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Every key added while the table grew under readers holds its last value");
+    for (unsigned int i = 0; i < SHARED_TEST_KEYS; i++) {
+        if (!shared_table_get(table, keys[i], &value)
+                || AS_INTEGER(value) != i + (SHARED_TEST_ROUNDS - 1) * SHARED_TEST_KEYS) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    if (table->elements != SHARED_TEST_KEYS + 1) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    free_shared_table(table);
+    for (unsigned int i = 0; i < SHARED_TEST_KEYS; i++) {
+        free(keys[i]);
+    }
+
+    END_TEST();
+}
+
+#endif /* _TEST_SHARED_TABLE_H_ */
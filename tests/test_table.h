@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "hash.h"
 #include "table.h"
 #include "value.h"
 
@@ -45,13 +46,22 @@ int test_ht_add_entry() {
     for (unsigned int i = 0; i < 3; i++) {
         Entry *e = get_entry(table, keys[i]);
 
-        if (strcmp(e->value.as.string, vals[i]) != 0) {
+        if (strcmp(AS_STRING(e->value), vals[i]) != 0) {
             TEST_FAIL();
             break;
         }
     }
     END_TEST_CASE();
 
+    BEGIN_TEST_CASE("get_entry finds entries by a copy of their key");
+    char key_copy[5];
+    strcpy(key_copy, keys[1]);
+    Entry *copy_entry = get_entry(table, key_copy);
+    if (copy_entry == NULL || copy_entry->key != keys[1]) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
     BEGIN_TEST_CASE("Deleting key results in get_entry returning NULL for that key");
     del_entry(table, keys[0]);
     if (get_entry(table, keys[0]) != NULL) {
@@ -68,7 +78,7 @@ int test_ht_add_entry() {
     if (e1 == NULL || e2 == NULL) {
         TEST_FAIL();
     } else {
-        if (strcmp(e1->value.as.string, "val1") != 0 || strcmp(e2->value.as.string, "val2") != 0) {
+        if (strcmp(AS_STRING(e1->value), "val1") != 0 || strcmp(AS_STRING(e2->value), "val2") != 0) {
             TEST_FAIL();
         }
     }
@@ -118,7 +128,7 @@ int test_ht_resize() {
     BEGIN_TEST_CASE("get_entry returns correct strings after resize");
     for (unsigned int i = 0; i < 8; i++) {
         Entry *e = get_entry(table, keys[i]);
-        if (strcmp(e->value.as.string, vals[i]) != 0) {
+        if (strcmp(AS_STRING(e->value), vals[i]) != 0) {
             TEST_FAIL();
         }
     }
@@ -154,9 +164,9 @@ int test_ht_stress() {
 
     int initial_capacity = table->capacity;
 
-    BEGIN_TEST_CASE("Table keys all NULL on init");
+    BEGIN_TEST_CASE("Table slots all empty on init");
     for (unsigned int i = 0; i < table->capacity; i++) {
-        if (table->entries[i].key != NULL) {
+        if (table->ctrl[i] != CTRL_EMPTY) {
             TEST_FAIL();
             break;
         }
@@ -211,7 +221,7 @@ int test_ht_stress() {
 
     BEGIN_TEST_CASE("Table entries all unoccupied or deleted after del_entry on every key");
     for (unsigned int i = 0; i < table->capacity; i++) {
-        if (table->entries[i].occupied && !table->entries[i].deleted) {
+        if (CTRL_IS_FULL(table->ctrl[i])) {
             TEST_FAIL();
             break;
         }
@@ -256,7 +266,7 @@ int test_ht_stress() {
 
     BEGIN_TEST_CASE("Table entries all unoccupied or deleted after del_entry on every key");
     for (unsigned int i = 0; i < table->capacity; i++) {
-        if (table->entries[i].occupied && !table->entries[i].deleted) {
+        if (CTRL_IS_FULL(table->ctrl[i])) {
             TEST_FAIL();
             break;
         }
@@ -273,4 +283,302 @@ int test_ht_stress() {
     END_TEST();
 }
 
+int test_ht_probe_lengths() {
+    INIT_TEST();
+    HashTable *table = init_table();
+
+    /* churn: add 2000 keys, delete every other one, then add 1000 more */
+    unsigned int num_keys = 3000;
+    char *keys[num_keys];
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = malloc(sizeof(char) * 12);
+        snprintf(keys[i], 12, i < 2000 ? "key%04d" : "new-key%04d", i);
+    }
+
+    for (unsigned int i = 0; i < 2000; i++) {
+        add_entry(table, keys[i], int_value(i));
+    }
+    for (unsigned int i = 0; i < 2000; i += 2) {
+        del_entry(table, keys[i]);
+    }
+    for (unsigned int i = 2000; i < num_keys; i++) {
+        add_entry(table, keys[i], int_value(i));
+    }
+
+    unsigned int histogram[TABLE_GROUP_WIDTH + 1];
+    table_probe_histogram(table, histogram, TABLE_GROUP_WIDTH + 1);
+
+    unsigned int counted = 0;
+    unsigned int total_length = 0;
+    for (unsigned int i = 0; i <= TABLE_GROUP_WIDTH; i++) {
+        counted += histogram[i];
+        total_length += i * histogram[i];
+    }
+
+    BEGIN_TEST_CASE("Probe length histogram counts every entry");
+    if (counted != table->elements || counted != 2000) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Mean probe length stays below one slot after churn");
+    if (total_length >= counted) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("No entry is more than a group away from its home slot");
+    if (histogram[TABLE_GROUP_WIDTH] != 0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Every remaining key is found after backward-shift deletion");
+    for (unsigned int i = 0; i < num_keys; i++) {
+        Entry *e = get_entry(table, keys[i]);
+        if ((i < 2000 && i % 2 == 0) ? e != NULL : (e == NULL || AS_INTEGER(e->value) != i)) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    free_table(table);
+    for (unsigned int i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+
+    END_TEST();
+}
+
+int test_ht_upsert() {
+    INIT_TEST();
+    HashTable *table = init_table();
+
+    unsigned int num_keys = 500;
+    char *keys[num_keys];
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = malloc(sizeof(char) * 8);
+        snprintf(keys[i], 8, "key%03d", i);
+    }
+
+    BEGIN_TEST_CASE("upsert_entry adds missing keys with the given value");
+    for (unsigned int i = 0; i < num_keys; i++) {
+        Entry *e = upsert_entry(table, keys[i], int_value(i));
+        if (e->key != keys[i] || AS_INTEGER(e->value) != i) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    if (table->elements != num_keys) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    unsigned int capacity = table->capacity;
+
+    BEGIN_TEST_CASE("Upserting existing keys updates them without adding entries or growing");
+    for (unsigned int round = 0; round < 10; round++) {
+        for (unsigned int i = 0; i < num_keys; i++) {
+            upsert_entry(table, keys[i], int_value(i + round));
+        }
+    }
+    if (table->elements != num_keys || table->capacity != capacity) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Upserted keys are found by a copy of the key");
+    char copy[8];
+    for (unsigned int i = 0; i < num_keys; i++) {
+        strcpy(copy, keys[i]);
+        Entry *e = get_entry(table, copy);
+        if (e == NULL || e->key != keys[i] || AS_INTEGER(e->value) != i + 9) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    free_table(table);
+    for (unsigned int i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+
+    END_TEST();
+}
+
+int test_ht_insertion_order() {
+    INIT_TEST();
+    HashTable *table = init_table();
+
+    /* enough keys for the slot indices to need 32 bits */
+    unsigned int num_keys = 50000;
+    char **keys = malloc(num_keys * sizeof *keys);
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = malloc(sizeof(char) * 10);
+        snprintf(keys[i], 10, "key%05d", i);
+        add_entry(table, keys[i], int_value(i));
+    }
+    for (unsigned int i = 0; i < num_keys; i += 3) {
+        del_entry(table, keys[i]);
+    }
+
+    BEGIN_TEST_CASE("Iteration returns entries in the order they were added, skipping deleted ones");
+    unsigned int position = 0;
+    unsigned int expected = 1;
+    Entry *e;
+    while ((e = table_next_entry(table, &position)) != NULL) {
+        if (e->key != keys[expected] || AS_INTEGER(e->value) != expected) {
+            TEST_FAIL();
+            break;
+        }
+        expected += expected % 3 == 2 ? 2 : 1;
+    }
+    if (expected < num_keys) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Every remaining key is found through the slot indices");
+    for (unsigned int i = 0; i < num_keys; i++) {
+        Entry *found = get_entry(table, keys[i]);
+        if (i % 3 == 0 ? found != NULL : (found == NULL || AS_INTEGER(found->value) != i)) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    for (unsigned int i = 0; i < num_keys; i++) {
+        del_entry(table, keys[i]);
+    }
+
+    BEGIN_TEST_CASE("Re-adding a deleted key reuses the holes without growing the table");
+    for (unsigned int i = 0; i < 1000; i++) {
+        add_entry(table, keys[0], int_value(i));
+        del_entry(table, keys[0]);
+    }
+    if (table->capacity != TABLE_DEFAULT_SIZE || table->elements != 0) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    free_table(table);
+    for (unsigned int i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+
+    END_TEST();
+}
+
+int test_ht_compact() {
+    INIT_TEST();
+    HashTable *table = init_table();
+
+    unsigned int num_keys = 1000;
+    char *keys[num_keys];
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = malloc(sizeof(char) * 8);
+        snprintf(keys[i], 8, "key%03d", i);
+        add_entry(table, keys[i], int_value(i));
+    }
+
+    /* not enough deletes for del_entry() to shrink the table itself */
+    for (unsigned int i = 0; i < 650; i++) {
+        del_entry(table, keys[i]);
+    }
+
+    TableStats before;
+    table_stats(table, &before);
+
+    BEGIN_TEST_CASE("Stats count live entries and the holes deleted ones left");
+    if (before.elements != 350 || before.holes != 650 || before.capacity != table->capacity
+            || before.memory != table_memory_usage(table)) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    table_compact(table);
+    TableStats after;
+    table_stats(table, &after);
+
+    BEGIN_TEST_CASE("Compacting shrinks the table to fit and drops the holes");
+    if (after.elements != 350 || after.holes != 0 || after.capacity >= before.capacity
+            || after.memory * 3 > before.memory) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Entries keep their values and order through compaction");
+    unsigned int position = 0;
+    for (unsigned int i = 650; i < num_keys; i++) {
+        Entry *e = table_next_entry(table, &position);
+        if (e == NULL || e->key != keys[i] || get_entry(table, keys[i]) != e
+                || AS_INTEGER(e->value) != i) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Compacting a compact table leaves it alone");
+    Entry *first = get_entry(table, keys[650]);
+    table_compact(table);
+    if (table->capacity != after.capacity || get_entry(table, keys[650]) != first) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    free_table(table);
+    for (unsigned int i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+
+    END_TEST();
+}
+
+int test_hash_bytes() {
+    INIT_TEST();
+
+    char key[300];
+    for (unsigned int i = 0; i < sizeof key; i++) {
+        key[i] = 'a' + i % 26;
+    }
+    char copy[sizeof key];
+    memcpy(copy, key, sizeof key);
+
+    BEGIN_TEST_CASE("Equal keys at different addresses hash the same");
+    for (unsigned int length = 0; length < sizeof key; length++) {
+        if (hash_bytes(key, length) != hash_bytes(copy, length)) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Changing any byte of a key changes its hash");
+    unsigned int lengths[] = { 3, 8, 13, 32, 49, 256 };
+    for (unsigned int i = 0; i < sizeof lengths / sizeof *lengths; i++) {
+        uint64_t hash = hash_bytes_seeded(key, lengths[i], 0);
+        for (unsigned int j = 0; j < lengths[i]; j++) {
+            copy[j] ^= 1;
+            if (hash_bytes_seeded(copy, lengths[i], 0) == hash) {
+                TEST_FAIL();
+            }
+            copy[j] ^= 1;
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("The seed changes the hash");
+    if (hash_bytes_seeded(key, 8, 1) == hash_bytes_seeded(key, 8, 2)) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
 #endif /* _TEST_TABLE_H_ */
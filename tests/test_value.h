@@ -0,0 +1,71 @@
+#ifndef _TEST_VALUE_H_
+#define _TEST_VALUE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "value.h"
+
+int test_value_encoding() {
+    INIT_TEST();
+
+    BEGIN_TEST_CASE("Doubles keep their type and value");
+    double doubles[] = { 0.0, -0.0, 1.5, -2.25, 1e300, -1e-300 };
+    for (unsigned int i = 0; i < sizeof doubles / sizeof *doubles; i++) {
+        Value v = double_value(doubles[i]);
+        if (!IS_DOUBLE(v) || VALUE_TYPE(v) != VAL_TYPE_DOUBLE || AS_DOUBLE(v) != doubles[i]) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("NaN is still a double");
+    Value nan = double_value(0.0 / 0.0);
+    if (!IS_DOUBLE(nan) || AS_DOUBLE(nan) == AS_DOUBLE(nan)) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Integers keep their sign and value");
+    long integers[] = { 0, 1, -1, 123456789, -123456789, VALUE_INT_MAX, VALUE_INT_MIN };
+    for (unsigned int i = 0; i < sizeof integers / sizeof *integers; i++) {
+        Value v = int_value(integers[i]);
+        if (!IS_INTEGER(v) || IS_DOUBLE(v) || AS_INTEGER(v) != integers[i]) {
+            TEST_FAIL();
+            break;
+        }
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Booleans, nil and strings are distinguished");
+    char *string = "motmot";
+    Value t = bool_value(1);
+    Value f = bool_value(0);
+    Value nil = nil_value();
+    Value s = string_ref_value(string);
+    if (!IS_BOOLEAN(t) || !AS_BOOLEAN(t) || !IS_BOOLEAN(f) || AS_BOOLEAN(f)
+            || !IS_NIL(nil) || IS_BOOLEAN(nil) || IS_DOUBLE(nil)
+            || !IS_STRING(s) || AS_STRING(s) != string || IS_OBJECT(s)) {
+        TEST_FAIL();
+    }
+    END_TEST_CASE();
+
+    BEGIN_TEST_CASE("Values are no larger than 16 bytes");
+#ifdef NAN_BOXING
+    if (sizeof(Value) != 8) {
+        TEST_FAIL();
+    }
+#else
+    if (sizeof(Value) > 16) {
+        TEST_FAIL();
+    }
+#endif /* NAN_BOXING */
+    END_TEST_CASE();
+
+    END_TEST();
+}
+
+#endif /* _TEST_VALUE_H_ */